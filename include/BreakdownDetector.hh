@@ -0,0 +1,63 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   BreakdownDetector.hh
+///
+///   This class watches the (V, I) points of one channel and tells when
+///   the job's stop rule says the pad has broken down.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+#pragma once
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include "ScanJob.hh"
+
+
+
+///-----------------------------------------------------------------------------
+/// Class declaration
+///-----------------------------------------------------------------------------
+class BreakdownDetector
+{
+	public:
+	//----------------------------------------------------------
+	// Constructors & destructor
+	//----------------------------------------------------------
+	explicit BreakdownDetector(const ScanJob& job);
+
+
+	//----------------------------------------------------------
+	// Public methods
+	//----------------------------------------------------------
+	// Next point of the channel. True when the sweep should stop here.
+	bool Feed(double V, double I);
+	void Reset();
+
+	const char* Reason() const { return reason; }
+
+
+	private:
+	//----------------------------------------------------------
+	// Private members
+	//----------------------------------------------------------
+	StopRule rule;
+	double Icompliance;
+	double slopeLimit;
+	int slopePoints;
+
+	bool havePrev;
+	double prevV;
+	double prevI;
+	int steep;  // Consecutive points above slopeLimit
+	const char* reason;
+};
@@ -0,0 +1,100 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   LiveCurve.hh
+///
+///   This class batches the measured points of the running scan into
+///   compact binary frames for WebSocket clients watching curves live.
+///
+///   Frame layout, little endian:
+///     u8  type    kFrameCurve
+///     u8  flags   bit 0: last frame of the channel
+///     u16 ch
+///     u32 job
+///     u32 seq     index of the channel's first point in the frame
+///     then (f32 V, f32 I) per point
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+#pragma once
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <optional>
+
+#include "ScanProgress.hh"
+
+
+
+///-----------------------------------------------------------------------------
+/// Points of one channel, ready to send
+///-----------------------------------------------------------------------------
+struct CurveFrame
+{
+	unsigned int job;
+	unsigned short int ch;
+	uint32_t seq;           // Index of the first point in the channel
+	std::vector<float> VI;  // V, I, V, I, ...
+	bool last;              // Channel finished
+};
+
+
+
+///-----------------------------------------------------------------------------
+/// Class declaration
+///-----------------------------------------------------------------------------
+class LiveCurve
+{
+	public:
+	//----------------------------------------------------------
+	// Constructors & destructor
+	//----------------------------------------------------------
+	LiveCurve();
+
+
+	//----------------------------------------------------------
+	// Public methods
+	//----------------------------------------------------------
+	void Begin(unsigned int job);
+	void End();
+
+	// Takes Step and ChannelEnd events. A frame once enough points are
+	// waiting, some time has passed, or the channel is over.
+	std::optional<CurveFrame> Apply(const ProgressEvent& ev);
+
+	// Binary frame keeping every stride-th point of the channel, and its
+	// last point
+	static std::string Encode(const CurveFrame& frame, unsigned int stride = 1);
+
+	static constexpr uint8_t kFrameCurve = 1;
+
+
+	private:
+	//----------------------------------------------------------
+	// Private members
+	//----------------------------------------------------------
+	struct Pending
+	{
+		uint32_t seq = 0;       // Points of the channel sent so far
+		std::vector<float> VI;
+		std::chrono::steady_clock::time_point since;
+	};
+
+	std::mutex mutex;
+	unsigned int job;
+	std::map<unsigned short int, Pending> pending;
+};
@@ -0,0 +1,93 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   MpscQueue.hh
+///
+///   Lock-free multi-producer, single-consumer queue (Vyukov's intrusive
+///   node queue). Any thread may Push; only one thread may Pop. A push is
+///   one allocation and one atomic exchange, and never waits for the
+///   consumer.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+#pragma once
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include <atomic>
+#include <optional>
+#include <utility>
+
+
+
+///-----------------------------------------------------------------------------
+/// Class declaration
+///-----------------------------------------------------------------------------
+template <typename T>
+class MpscQueue
+{
+	public:
+	//----------------------------------------------------------
+	// Constructors & destructor
+	//----------------------------------------------------------
+	MpscQueue() : head(new Node()), tail(head . load())
+	{
+	}
+
+	~MpscQueue()
+	{
+		while ( Pop() ) {}
+		delete tail;
+	}
+
+	MpscQueue(const MpscQueue&) = delete;
+	MpscQueue& operator=(const MpscQueue&) = delete;
+
+
+	//----------------------------------------------------------
+	// Public methods
+	//----------------------------------------------------------
+	// Any thread
+	void Push(T value)
+	{
+		Node* n = new Node();
+		n -> value = std::move(value);
+		Node* prev = head . exchange(n, std::memory_order_acq_rel);
+		prev -> next . store(n, std::memory_order_release);
+	}
+
+	// Consumer thread only. May miss an item whose push is still under
+	// way; the producer's wake-up brings the consumer back for it.
+	std::optional<T> Pop()
+	{
+		Node* next = tail -> next . load(std::memory_order_acquire);
+		if ( !next ) return std::nullopt;
+
+		T value = std::move(next -> value);
+		delete tail;
+		tail = next;
+		return value;
+	}
+
+
+	private:
+	//----------------------------------------------------------
+	// Private members
+	//----------------------------------------------------------
+	struct Node
+	{
+		std::atomic<Node*> next{nullptr};
+		T value{};
+	};
+
+	std::atomic<Node*> head;  // Last pushed, producers
+	Node* tail;               // Already consumed, consumer
+};
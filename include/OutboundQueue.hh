@@ -0,0 +1,127 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   OutboundQueue.hh
+///
+///   This class holds the messages waiting to be written to one
+///   WebSocket client. It is bounded: when the client falls behind,
+///   snapshots are coalesced and deltas dropped before anything the
+///   client must see is given up.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+#pragma once
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <optional>
+
+
+
+///-----------------------------------------------------------------------------
+/// Serialized message with headroom in front for the frame header the
+/// writer puts there (LWS_PRE). One payload is shared by every client
+/// queue it is on; writes happen one at a time on the service thread.
+///-----------------------------------------------------------------------------
+class Payload
+{
+	public:
+	Payload(const unsigned char* data, size_t size, size_t headroom) : buf(headroom + size), head(headroom)
+	{
+		std::copy(data, data + size, buf . begin() + head);
+	}
+
+	Payload(const std::string& data, size_t headroom)
+		: Payload(reinterpret_cast<const unsigned char*>(data . data()), data . size(), headroom)
+	{
+	}
+
+	unsigned char* Data() { return buf . data() + head; }
+	size_t Size() const { return buf . size() - head; }
+
+
+	private:
+	std::vector<unsigned char> buf;
+	size_t head;
+};
+
+
+
+///-----------------------------------------------------------------------------
+/// What may happen to a queued message when the client falls behind
+///-----------------------------------------------------------------------------
+enum class Backlog
+{
+	Keep,     // Replies and job notices: always delivered
+	Replace,  // Snapshots: a newer one of the same key supersedes it
+	Drop      // Deltas: given up first when the queue is full
+};
+
+struct OutboundMessage
+{
+	std::shared_ptr<Payload> payload;
+	bool binary = false;
+	Backlog backlog = Backlog::Keep;
+	std::string key;    // Replace only
+};
+
+
+
+///-----------------------------------------------------------------------------
+/// Class declaration
+///-----------------------------------------------------------------------------
+class OutboundQueue
+{
+	public:
+	//----------------------------------------------------------
+	// Constructors & destructor
+	//----------------------------------------------------------
+	OutboundQueue(size_t maxMessages = 256, size_t maxBytes = 1 << 20);
+
+
+	//----------------------------------------------------------
+	// Public methods
+	//----------------------------------------------------------
+	// False when the message does not fit even after coalescing and
+	// dropping deltas; the client is then too slow to keep.
+	bool Push(OutboundMessage m);
+	std::optional<OutboundMessage> Pop();
+
+	bool Empty() const { return queue . empty(); }
+	size_t Size() const { return queue . size(); }
+	size_t Bytes() const { return bytes; }
+	size_t Dropped() const { return dropped; }
+
+	// Over half full
+	bool Backlogged() const { return queue . size() * 2 > maxMessages || bytes * 2 > maxBytes; }
+
+
+	private:
+	//----------------------------------------------------------
+	// Private members
+	//----------------------------------------------------------
+	std::deque<OutboundMessage> queue;
+	size_t maxMessages;
+	size_t maxBytes;
+	size_t bytes;
+	size_t dropped;
+
+
+	//----------------------------------------------------------
+	// Private methods
+	//----------------------------------------------------------
+	bool Fits(size_t size) const;
+};
@@ -0,0 +1,97 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   PadSummary.hh
+///
+///   This class keeps a wafer map of the sensor: leakage current at a
+///   reference voltage and breakdown voltage of every pad, laid out on
+///   the PinGrid rows and columns. Pads are updated from the progress
+///   events as each channel finishes; no result file is read back.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+#pragma once
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <optional>
+
+#include "ScanProgress.hh"
+
+
+
+///-----------------------------------------------------------------------------
+/// Class declaration
+///-----------------------------------------------------------------------------
+class PadSummary
+{
+	public:
+	//----------------------------------------------------------
+	// Constructors & destructor
+	//----------------------------------------------------------
+	PadSummary();
+
+
+	//----------------------------------------------------------
+	// Public methods
+	//----------------------------------------------------------
+	// Grid geometry; a different one forgets every pad
+	void SetGeometry(unsigned short int rows, unsigned short int cols);
+	void SetReference(double V);
+
+	void Begin(unsigned int job);
+	void End();
+
+	// True when the event finished a pad
+	bool Apply(const ProgressEvent& ev);
+
+	// JSON handling
+	std::string ToJSONString();
+
+	// Kept across restarts
+	bool Save(const std::string& path);
+	bool Load(const std::string& path);
+
+
+	private:
+	//----------------------------------------------------------
+	// Private members
+	//----------------------------------------------------------
+	struct Pad
+	{
+		unsigned int job = 0;              // 0: never measured
+		std::optional<double> leakage;     // A at Vref, none if not reached
+		std::optional<double> breakdown;   // V, none if the pad held to Vend
+	};
+
+	// Channel being swept
+	struct OpenPad
+	{
+		size_t points = 0;
+		double prevV = 0;
+		double prevI = 0;
+		std::optional<double> leakage;
+		std::optional<double> breakdown;
+	};
+
+	std::mutex mutex;
+	unsigned short int rows;
+	unsigned short int cols;
+	double Vref;
+	bool active;
+	unsigned int job;
+	std::vector<Pad> pads;                        // Row major, index = channel
+	std::map<unsigned short int, OpenPad> open;
+};
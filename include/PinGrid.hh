@@ -22,6 +22,7 @@
 #include <vector>
 #include <string>
 #include <iostream>
+#include <mutex>
 
 
 
@@ -71,6 +72,7 @@ class PinGrid
 	unsigned short int mRows;
 	unsigned short int mCols;
 	std::vector<bool> mPins;
+	mutable std::mutex mMutex;  // Set from the serial monitor and the command workers
 
 	// Inspectors
 	bool IsValidCoord(unsigned short int row, unsigned short int col) const;
@@ -0,0 +1,120 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   ResultStore.hh
+///
+///   This class keeps IV measurement records of one scan job in an
+///   append-only, memory-mapped columnar file.
+///
+///   Layout: a 64 byte header, then blocks of kBlockRecords records.
+///   Each block holds the channel, voltage, current and timestamp
+///   columns one after another. The per-channel index of record runs
+///   is kept in memory and rebuilt from the channel column on open.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+#pragma once
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <utility>
+
+
+
+///-----------------------------------------------------------------------------
+/// Class declaration
+///-----------------------------------------------------------------------------
+class ResultStore
+{
+	public:
+	//----------------------------------------------------------
+	// Constructors & destructor
+	//----------------------------------------------------------
+	ResultStore();
+	~ResultStore();
+
+	ResultStore(const ResultStore&) = delete;
+	ResultStore& operator=(const ResultStore&) = delete;
+
+
+	//----------------------------------------------------------
+	// Public methods
+	//----------------------------------------------------------
+	bool Create(const std::string& path, unsigned int job);  // For writing
+	bool Open(const std::string& path);                      // Read only
+	void Close();
+	bool IsOpen();
+	unsigned int GetJob();
+	const std::string& GetPath() const { return path; }
+
+	bool Append(unsigned short int ch, double V, double I, double t);
+
+	// One channel's curve, in measurement order
+	bool GetCurve(unsigned short int ch, std::vector<double>& V, std::vector<double>& I, std::vector<double>& t);
+	std::vector<std::pair<unsigned short int, size_t>> GetChannels();  // (channel, records)
+
+	// JSON handling
+	std::string CurveToJSONString(unsigned short int ch);
+	std::string ChannelsToJSONString();
+
+	static std::string PathFor(const std::string& dir, unsigned int job);
+
+	static constexpr uint32_t kBlockRecords = 4096;
+
+
+	private:
+	//----------------------------------------------------------
+	// Private members
+	//----------------------------------------------------------
+	struct Header
+	{
+		char     magic[8];
+		uint32_t version;
+		uint32_t job;
+		uint64_t count;
+		uint32_t blockRecords;
+		uint32_t reserved[9];
+	};
+
+	std::mutex mutex;
+	std::string path;
+	int fd;
+	bool writable;
+	uint8_t* base;
+	size_t mapped;
+
+	// channel -> runs of record numbers [begin, end)
+	std::map<unsigned short int, std::vector<std::pair<uint64_t, uint64_t>>> index;
+
+
+	//----------------------------------------------------------
+	// Private methods
+	//----------------------------------------------------------
+	Header* GetHeader() const { return reinterpret_cast<Header*>(base); }
+	uint8_t* Block(uint64_t b) const;
+	uint16_t* ChannelColumn(uint64_t b) const;
+	double* VoltageColumn(uint64_t b) const;
+	double* CurrentColumn(uint64_t b) const;
+	double* TimeColumn(uint64_t b) const;
+
+	bool Map(size_t size);
+	bool Grow();
+	void Index(uint64_t rec, unsigned short int ch);
+	void RebuildIndex();
+	void CloseLocked();
+
+	static size_t BlockSize();
+};
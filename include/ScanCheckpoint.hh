@@ -0,0 +1,83 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   ScanCheckpoint.hh
+///
+///   This class records which channels of a scan job are finished, so an
+///   interrupted scan can be resumed with the remaining channels only.
+///
+///   <datadir>/jobNNNNNN.ckpt: the scan parameters as one JSON line, then
+///   one line per finished channel. Lines are appended and synced as the
+///   channels end; the file goes away when the job completes.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+#pragma once
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include <string>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <optional>
+
+#include "ScanJob.hh"
+
+
+
+///-----------------------------------------------------------------------------
+/// Class declaration
+///-----------------------------------------------------------------------------
+class ScanCheckpoint
+{
+	public:
+	//----------------------------------------------------------
+	// Constructors & destructor
+	//----------------------------------------------------------
+	ScanCheckpoint();
+	~ScanCheckpoint();
+
+
+	//----------------------------------------------------------
+	// Public methods
+	//----------------------------------------------------------
+	// Writing, for the running job
+	bool Begin(const std::string& dir, const ScanJob& job);
+	bool Complete(unsigned short int ch);
+	void End(bool keep);  // Keep it when the job did not finish
+
+	// Reading, for any job
+	struct Saved
+	{
+		ScanJob job;                          // Parameters, with the id filled in
+		std::set<unsigned short int> done;
+	};
+	static std::optional<Saved> Load(const std::string& dir, unsigned int job);
+	static std::vector<unsigned int> List(const std::string& dir);
+	static bool Remove(const std::string& dir, unsigned int job);
+	static std::string PathFor(const std::string& dir, unsigned int job);
+
+	// Channels of a saved job still to measure
+	static std::vector<unsigned short int> Remaining(const Saved& saved);
+
+	// JSON handling: resumable jobs in dir
+	static std::string ListToJSONString(const std::string& dir);
+
+
+	private:
+	//----------------------------------------------------------
+	// Private members
+	//----------------------------------------------------------
+	std::mutex mutex;
+	std::string path;
+	int fd;
+};
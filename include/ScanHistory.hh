@@ -0,0 +1,115 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   ScanHistory.hh
+///
+///   This class keeps timing and resource accounting of finished scans:
+///   wall time, child startup, CPU and memory from wait4, and per-channel
+///   durations split into relay settling, sweep and ramp-down.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+#pragma once
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include <sys/resource.h>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <optional>
+#include <map>
+
+#include "ScanJob.hh"
+#include "ScanProgress.hh"
+
+
+
+///-----------------------------------------------------------------------------
+/// Accounting of one scan
+///-----------------------------------------------------------------------------
+struct ChannelTiming
+{
+	unsigned short int ch;
+	double start;    // Seconds since the epoch
+	double settle;   // Channel start to first point: relay and first step
+	double sweep;    // First to last point
+	double rampDown; // Last point to channel end: ramp down and relay open
+	size_t steps;
+};
+
+struct ScanRecord
+{
+	unsigned int job;
+	ScanEngine engine;
+	ScanJobState state;
+	double wall;          // Seconds, scheduler start to end
+	double startup;       // Milliseconds, spawn to first output; -1 if none
+	double userCPU;       // Seconds
+	double systemCPU;     // Seconds
+	long maxRSS;          // Kilobytes
+	std::vector<ChannelTiming> channels;
+};
+
+
+
+///-----------------------------------------------------------------------------
+/// Class declaration
+///-----------------------------------------------------------------------------
+class ScanHistory
+{
+	public:
+	//----------------------------------------------------------
+	// Constructors & destructor
+	//----------------------------------------------------------
+	ScanHistory();
+
+
+	//----------------------------------------------------------
+	// Public methods
+	//----------------------------------------------------------
+	void Begin(unsigned int job, ScanEngine engine);
+	void Apply(const ProgressEvent& ev);
+	void SetStartup(double ms);
+	void SetUsage(const struct rusage& usage);
+	void End(ScanJobState state);
+
+	std::optional<ScanRecord> GetRecord(unsigned int job);
+
+	// JSON handling. All records, or the one of a job.
+	std::string ToJSONString(std::optional<unsigned int> job = std::nullopt);
+
+	static constexpr size_t kMaxRecords = 256;
+
+
+	private:
+	//----------------------------------------------------------
+	// Private members
+	//----------------------------------------------------------
+	std::mutex mutex;
+	std::deque<ScanRecord> records;
+
+	bool active;
+	ScanRecord current;
+	std::chrono::steady_clock::time_point startTime;
+
+	// Channels in progress; a SweepPool runs several at once
+	struct OpenChannel
+	{
+		size_t index;      // Into current . channels
+		double firstStep;  // 0 until the first point
+		double lastStep;
+	};
+	std::map<unsigned short int, OpenChannel> open;
+};
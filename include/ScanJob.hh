@@ -0,0 +1,151 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   ScanJob.hh
+///
+///   This class describes one queued scan request.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+#pragma once
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include <string>
+#include <vector>
+#include <optional>
+
+
+
+///-----------------------------------------------------------------------------
+/// Job state
+///-----------------------------------------------------------------------------
+enum class ScanJobState
+{
+	Queued,
+	Running,
+	Done,
+	Failed,
+	Cancelled
+};
+
+
+
+///-----------------------------------------------------------------------------
+/// What runs the sweep
+///-----------------------------------------------------------------------------
+enum class ScanEngine
+{
+	Script,  // iv_all.py child process
+	Native,  // in-daemon SweepEngine
+	Worker   // warm scan_worker.py, see ScanWorker
+};
+
+
+
+///-----------------------------------------------------------------------------
+/// When to cut a channel's sweep short
+///-----------------------------------------------------------------------------
+enum class StopRule
+{
+	None,        // Always sweep to Vend
+	Compliance,  // Current reached Icompliance
+	Slope,       // |dI/dV| above slopeLimit for slopePoints points in a row
+	Any          // Either of the two
+};
+
+
+
+///-----------------------------------------------------------------------------
+/// How the sweep picks its voltages
+///-----------------------------------------------------------------------------
+enum class Stepping
+{
+	Fixed,    // Every Vstep from Vstart to Vend
+	Adaptive  // Vstep as the first step, then VoltageStepper decides
+};
+
+
+
+///-----------------------------------------------------------------------------
+/// Class declaration
+///-----------------------------------------------------------------------------
+class ScanJob
+{
+	public:
+	//----------------------------------------------------------
+	// Constructors & destructor
+	//----------------------------------------------------------
+	ScanJob();
+
+
+	//----------------------------------------------------------
+	// Public methods
+	//----------------------------------------------------------
+	// Argument vector for the scan script
+	std::vector<std::string> ToArgv(const std::string& script) const;
+
+	// JSON handling. FromJSONString checks the message against the schema.
+	std::string ToJSONString() const;
+	std::string ParamsToJSONString() const;  // Scan parameters only; FromJSONString takes it back
+	bool FromJSONString(const std::string& json, std::string* error = nullptr);
+	static std::string SchemaToJSONString();
+
+	// Finished one way or another?
+	bool IsFinished() const;
+
+	// Sweep points: Vstart towards Vend, Vend included. Fixed stepping only.
+	std::vector<double> Voltages() const;
+
+	// Most points a channel can take
+	size_t PointCount() const;
+
+	// Number of channels the job visits
+	size_t ChannelCount() const;
+
+	static const char* StateName(ScanJobState s);
+	static const char* EngineName(ScanEngine e);
+	static const char* StopRuleName(StopRule r);
+	static const char* SteppingName(Stepping s);
+
+
+	//----------------------------------------------------------
+	// Public members
+	//----------------------------------------------------------
+	unsigned int id;
+	int priority;                              // Higher runs first
+	ScanJobState state;
+	bool cancelRequested;
+	std::optional<int> exitStatus;
+	unsigned int resumes;                      // Job this one finishes, 0 if none
+
+	// Scan parameters
+	std::string sensorname;
+	double Vstart;
+	double Vend;
+	double Vstep;
+	double Icompliance;
+	std::vector<unsigned short int> channels;  // Empty means all channels
+	std::string basepath;                      // Empty lets the script decide
+	bool dryrun;
+	ScanEngine engine;
+
+	// Early stop on breakdown, native engine only
+	StopRule stopRule;
+	double slopeLimit;                         // A/V
+	int slopePoints;
+
+	// Adaptive stepping, native engine only
+	Stepping stepping;
+	double VstepMin;
+	double VstepMax;
+	int maxPoints;                             // Per channel
+};
@@ -19,20 +19,40 @@
 ///-----------------------------------------------------------------------------
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/time.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <signal.h>
+#include <spawn.h>
 
 #include <string>
 #include <vector>
 #include <thread>
 #include <atomic>
 #include <mutex>
+#include <condition_variable>
+#include <deque>
 #include <optional>
 #include <sstream>
 #include <iostream>
 #include <chrono>
+#include <utility>
+
+#include "ScanJob.hh"
+#include "SweepPool.hh"
+#include "ScanProgress.hh"
+#include "ResultStore.hh"
+#include "ScanHistory.hh"
+#include "ScanWorker.hh"
+#include "ScanCheckpoint.hh"
+#include "LiveCurve.hh"
+#include "PadSummary.hh"
 
 
 
@@ -45,36 +65,115 @@ class ScanManager
 	ScanManager();
 	~ScanManager();
 
-	void SetCMD(const std::string& cmd);
+	void SetScript(const std::string& path);
+	bool SetSMU(const std::string& spec);
+	void StartWorker(unsigned int recycle);
+	void SetDataDir(const std::string& dir);
+	void SetReferenceVoltage(double V) { pads . SetReference(V); }
 
-	bool Start(unsigned short int mode = 0);
+	bool Start(const ScanJob& job);
 	bool IsRunning();
+	bool IsSweeping() const { return native . load() || warm . load(); }  // Native or worker job switching the matrix
 	void Stop(int timeout_ms = 2000);
+	bool Terminate(int timeout_ms = 2000);
 	std::optional<int> GetExitStatus();
 
 	std::string ReadStdOut();
 	std::string ReadStdErr();
 	void Wait();
 
+	// Process launch
+	static pid_t Spawn(const std::vector<std::string>& argv, const std::vector<std::pair<int, int>>& fds,
+	                   const std::vector<std::string>& extraEnv = {});
+	static std::vector<std::string> SanitizedEnvironment();
+	static void BenchmarkSpawn(const std::vector<std::string>& argv, int runs, std::ostream& os = std::cout);
+
+	// Job queue
+	unsigned int Enqueue(ScanJob job);
+	bool Cancel(unsigned int id);
+	bool Reorder(unsigned int id, int priority);
+	std::optional<ScanJob> GetJob(unsigned int id);
+	unsigned int Resume(unsigned int id, std::string* error = nullptr);  // New job id, 0 on error
+
 	// JSON handling
-	std::string ToJSONString() const;
+	std::string ToJSONString();
+	std::string JobsToJSONString();
+	std::string ProgressToJSONString();
+	std::string CurveToJSONString(unsigned int job, std::optional<unsigned short int> ch);
+	std::string HistoryToJSONString(std::optional<unsigned int> job = std::nullopt);
+	std::string WorkerToJSONString();
+	std::string CheckpointsToJSONString();
+	std::string HeatmapToJSONString() { return pads . ToJSONString(); }
 
 
 	private:
-	void CleanupReaders();
-	void ReaderThread(int fd, std::string& outBuf, std::mutex& bufMutex);
-
-	std::string command;
+	void ReactorLoop();
+	void OnChildOutput(int fd);
+	void OnChildExit();
+	void HandleEvent(const ProgressEvent& ev);
+	void DeliverLog(const char* stream, const char* buf, ssize_t n);
+	void OpenStore(unsigned int job);
+	void CloseChildFds();
+	void SchedulerLoop();
+	bool RunNative(const ScanJob& job);
+	bool RunWorker(const ScanJob& job);
+	void NotifyJob(const ScanJob& job);
+	ScanJob* FindJob(unsigned int id);
+	void PruneJobs();
+
+	std::vector<std::string> argv_;
+	std::string script;
 	pid_t pid_;
 	std::atomic<bool> running;
 	int stdout_fd, stderr_fd;
+	int progress_fd;  // JSON-lines events, fd 3 in the child
+	ScanProgress progress;
+	ScanHistory history;
+	LiveCurve live;  // Points on their way to WebSocket clients
+
+	// Measured points, one columnar store per job under datadir. The reader
+	// keeps the last finished job open for curve requests; reader_mutex also
+	// covers closing the writer.
+	std::string datadir;
+	ResultStore store;
+	ResultStore reader;
+	std::mutex reader_mutex;
+
+	// Finished channels of the running job, for Resume
+	ScanCheckpoint checkpoint;
+
+	// Wafer map of all pads, saved to datadir after every job
+	PadSummary pads;
 
-	std::thread stdout_thread;
-	std::thread stderr_thread;
 	std::string stdout_buf;
 	std::string stderr_buf;
 	std::mutex stdout_mutex, stderr_mutex;
 
+	// Child supervision. One reactor thread watches the pidfd, the output
+	// pipes and the kill timer. status_mutex guards the child fds as well.
+	std::thread reactor_thread;
+	std::atomic<bool> reactor_quit;
+	int epoll_fd, wake_fd, timer_fd, pid_fd;
 	std::mutex status_mutex;
+	std::condition_variable exit_cv;
 	std::optional<int> exit_status;
+	std::chrono::steady_clock::time_point spawn_time;
+	bool first_output;
+
+	// In-daemon sweeps
+	SweepPool sweep;
+	std::atomic<bool> native;
+
+	// Warm Python worker
+	ScanWorker worker;
+	std::atomic<bool> warm;
+
+	// Job queue. Finished jobs are kept for a while so clients can query them.
+	std::thread scheduler_thread;
+	std::mutex queue_mutex;
+	std::condition_variable queue_cv;
+	std::deque<ScanJob> jobs;
+	unsigned int next_job_id;
+	unsigned int current_job;
+	bool scheduler_quit;
 };
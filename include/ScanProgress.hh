@@ -0,0 +1,113 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   ScanProgress.hh
+///
+///   This class follows the progress of the running scan. Scan children
+///   write JSON lines to the progress fd, the native engine reports the
+///   same events directly.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+#pragma once
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <optional>
+#include <map>
+
+
+
+///-----------------------------------------------------------------------------
+/// Progress event
+///-----------------------------------------------------------------------------
+enum class ProgressKind
+{
+	ChannelStart,
+	Step,
+	ChannelEnd,
+	Compliance,
+	Breakdown   // The sweep of the channel was stopped early
+};
+
+struct ProgressEvent
+{
+	ProgressKind kind;
+	unsigned short int ch;
+	double V;  // Volt,   Step, Compliance and Breakdown only
+	double I;  // Ampere, Step, Compliance and Breakdown only
+	double t;  // Seconds since the epoch
+	bool ok = true;  // ChannelEnd only: false when the channel was cut short
+};
+
+
+
+///-----------------------------------------------------------------------------
+/// Class declaration
+///-----------------------------------------------------------------------------
+class ScanProgress
+{
+	public:
+	//----------------------------------------------------------
+	// Constructors & destructor
+	//----------------------------------------------------------
+	ScanProgress();
+
+
+	//----------------------------------------------------------
+	// Public methods
+	//----------------------------------------------------------
+	void Begin(unsigned int job, size_t channels, size_t stepsPerChannel);
+	void End();
+
+	// Raw bytes from the progress fd. Returns the events of the lines
+	// completed by them; malformed lines are skipped.
+	std::vector<ProgressEvent> Feed(const char* data, size_t len);
+
+	// One event. True when a broadcast is due.
+	bool Apply(const ProgressEvent& ev);
+
+	static std::optional<ProgressEvent> ParseLine(const std::string& line);
+
+	void SetInterval(int ms) { intervalMs = ms; }
+
+	// JSON handling
+	std::string ToJSONString();
+
+
+	private:
+	//----------------------------------------------------------
+	// Private members
+	//----------------------------------------------------------
+	std::mutex mutex;
+	std::string lineBuffer;
+	int intervalMs;
+	std::chrono::steady_clock::time_point lastPublish;
+
+	bool active;
+	unsigned int jobId;
+	size_t channelsTotal;
+	size_t channelsDone;
+	size_t stepsPerChannel;
+	std::map<unsigned short int, size_t> openChannels;  // Steps so far; several with a SweepPool
+	int currentChannel;
+	double lastV;
+	double lastI;
+	size_t complianceHits;
+	size_t breakdowns;
+	std::chrono::steady_clock::time_point startTime;
+
+	std::string ToJSONStringLocked() const;
+};
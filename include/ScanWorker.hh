@@ -0,0 +1,118 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   ScanWorker.hh
+///
+///   This class supervises a long-lived scan_worker.py. The worker imports
+///   the measurement stack once and takes jobs over a Unix socket on fd 3:
+///   one {"cmd":"run","job":{...}} line in, progress events and a closing
+///   {"ev":"job_end","ok":...} line out. A crashed worker is restarted with
+///   backoff, and it is recycled after a number of jobs.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+#pragma once
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <functional>
+#include <condition_variable>
+
+#include "ScanJob.hh"
+#include "ScanProgress.hh"
+
+
+
+///-----------------------------------------------------------------------------
+/// Class declaration
+///-----------------------------------------------------------------------------
+class ScanWorker
+{
+	public:
+	//----------------------------------------------------------
+	// Constructors & destructor
+	//----------------------------------------------------------
+	ScanWorker();
+	~ScanWorker();
+
+
+	//----------------------------------------------------------
+	// Public methods
+	//----------------------------------------------------------
+	void SetScript(const std::string& path) { script = path; }
+	void SetRecycle(unsigned int jobs) { recycleAfter = jobs; }  // 0: never
+	void SetListener(std::function<void(const ProgressEvent&)> l) { listener = std::move(l); }
+
+	// Keep a worker warm in the background. Without it Run launches one on demand.
+	void Start();
+	void Stop();
+
+	// Blocks until the job is done. False on error, abort or worker crash.
+	// CPU time the worker spent on the job goes to usage, the time from
+	// sending the job to its first event to startup_ms.
+	bool Run(const ScanJob& job, struct rusage* usage = nullptr, double* startup_ms = nullptr);
+	void Abort();
+	void ClearAbort() { abortRequested = false; }  // Before the job, not in Run: an early abort must stick
+
+	// JSON handling
+	std::string ToJSONString();
+
+
+	private:
+	//----------------------------------------------------------
+	// Private members
+	//----------------------------------------------------------
+	std::string script;
+	unsigned int recycleAfter;
+	std::function<void(const ProgressEvent&)> listener;
+
+	// mutex is held for a whole job, and while (re)launching
+	std::mutex mutex;
+	pid_t pid;
+	int sock;
+	std::string lineBuffer;
+	unsigned int jobsServed;  // By the current worker
+	unsigned int restarts;
+
+	std::atomic<pid_t> busyPid;
+	std::atomic<bool> abortRequested;
+	std::chrono::steady_clock::time_point abortTime;
+
+	// Supervisor
+	std::thread supervisor;
+	std::mutex quit_mutex;
+	std::condition_variable quit_cv;
+	bool quit;
+	int backoffMs;
+	std::chrono::steady_clock::time_point nextLaunch;
+
+
+	//----------------------------------------------------------
+	// Private methods
+	//----------------------------------------------------------
+	void SuperviseLoop();
+	bool Launch();
+	void Shutdown();
+	bool Reap(bool block);
+	bool WriteLine(const std::string& line);
+	std::optional<std::string> ReadLine(int timeout_ms, bool& eof);
+
+	static bool ReadUsage(pid_t p, double& user, double& sys, long& maxRSS);
+};
@@ -24,6 +24,8 @@
 #include <mutex>
 #include <atomic>
 #include <optional>
+#include <vector>
+#include <utility>
 
 #include "global.hh"
 
@@ -54,6 +56,10 @@ class SerialManager
 	bool SetPinStat(unsigned short int index, bool val);
 	bool SetPinStat(unsigned short int row, unsigned short int col, bool val);
 
+	// Several pins as one transaction: nothing else switches meanwhile,
+	// OFFs go before ONs, and on failure the pins already switched go back
+	bool SetPinStats(const std::vector<std::pair<unsigned short int, bool>>& pins);
+
 
 	private:
 	//----------------------------------------------------------
@@ -65,6 +71,7 @@ class SerialManager
 	std::mutex bufferMutex;
 	std::string responseBuffer;
 	std::atomic<bool> isConnected{false};
+	std::mutex switchMutex;  // One switching command or transaction at a time
 
 
 	//----------------------------------------------------------
@@ -72,4 +79,5 @@ class SerialManager
 	//----------------------------------------------------------
 	void MonitorSerial();
 	bool SetupSerialPort(int fd);
+	bool SwitchPin(unsigned short int index, bool val);
 };
@@ -0,0 +1,73 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   SmuLink.hh
+///
+///   This class talks SCPI lines to a source-meter over serial or TCP.
+///   "tcp://host:port" opens a socket, anything else is a tty device path.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+#pragma once
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include <string>
+#include <optional>
+
+
+
+///-----------------------------------------------------------------------------
+/// Class declaration
+///-----------------------------------------------------------------------------
+class SmuLink
+{
+	public:
+	//----------------------------------------------------------
+	// Constructors & destructor
+	//----------------------------------------------------------
+	SmuLink();
+	SmuLink(const std::string& url);
+	~SmuLink();
+
+
+	//----------------------------------------------------------
+	// Public methods
+	//----------------------------------------------------------
+	bool Open();
+	void Close();
+	bool IsOpen() const { return fd >= 0; }
+
+	void SetURL(const std::string& u) { url = u; }
+	const std::string& GetURL() const { return url; }
+
+	// SCPI I/O
+	bool WriteLine(const std::string& line);
+	std::optional<std::string> ReadLine(int timeout_ms = 2000);
+	std::optional<std::string> Query(const std::string& line, int timeout_ms = 2000);
+
+
+	private:
+	//----------------------------------------------------------
+	// Private members
+	//----------------------------------------------------------
+	std::string url;
+	int fd = -1;
+	std::string rxBuffer;
+
+
+	//----------------------------------------------------------
+	// Private methods
+	//----------------------------------------------------------
+	bool OpenTCP(const std::string& host, const std::string& port);
+	bool OpenSerial(const std::string& dev);
+	void Flush();
+};
@@ -0,0 +1,115 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   SweepEngine.hh
+///
+///   This class runs IV sweeps in the daemon itself. It switches the matrix
+///   through SerialManager and steps the source-meter through SmuLink.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+#pragma once
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <functional>
+
+#include "ScanJob.hh"
+#include "SmuLink.hh"
+#include "ScanProgress.hh"
+
+
+
+///-----------------------------------------------------------------------------
+/// One measured point
+///-----------------------------------------------------------------------------
+struct IVPoint
+{
+	unsigned short int channel;
+	double V;  // Volt
+	double I;  // Ampere
+	double t;  // Seconds since the epoch
+};
+
+
+
+///-----------------------------------------------------------------------------
+/// Class declaration
+///-----------------------------------------------------------------------------
+class SweepEngine
+{
+	public:
+	//----------------------------------------------------------
+	// Constructors & destructor
+	//----------------------------------------------------------
+	SweepEngine();
+	~SweepEngine();
+
+
+	//----------------------------------------------------------
+	// Public methods
+	//----------------------------------------------------------
+	void SetSMU(const std::string& url) { smu . SetURL(url); }
+	void SetSettle(int relay_ms, int step_ms);
+	void SetListener(std::function<void(const ProgressEvent&)> l) { listener = std::move(l); }
+
+	// Matrix rows this engine may switch; all rows by default
+	void SetBank(int first_row, int last_row);
+	bool InBank(unsigned short int ch) const;
+
+	// Blocks until the job is done. False on error or abort.
+	bool Run(const ScanJob& job);
+	void Abort() { abortRequested = true; }
+	void ClearAbort() { abortRequested = false; }  // Before the job, not in Run: an early abort must stick
+
+	// Held for every matrix switching, here and in the WebSocket set command
+	static std::mutex& RelayMutex() { return relayMutex; }
+
+
+	private:
+	//----------------------------------------------------------
+	// Private members
+	//----------------------------------------------------------
+	SmuLink smu;
+	std::atomic<bool> abortRequested{false};
+	int relaySettleMs;
+	int stepSettleMs;
+	double outputV;  // Last voltage applied
+	int firstRow;
+	int lastRow;
+	int closedRelay; // -1 if none
+	std::function<void(const ProgressEvent&)> listener;
+
+	// Engines of a pool share one serial link and one grid
+	static std::mutex relayMutex;
+
+
+	//----------------------------------------------------------
+	// Private methods
+	//----------------------------------------------------------
+	bool ConfigureSMU(const ScanJob& job);
+	void ShutdownSMU(const ScanJob& job);
+	bool SweepChannel(const ScanJob& job, unsigned short int ch, std::vector<IVPoint>& points);
+	bool RampTo(double target, double step);
+	static double RampStep(const ScanJob& job);
+	std::optional<IVPoint> Measure(unsigned short int ch, double v);
+	bool MayClose(unsigned short int ch) const;
+	bool SetRelay(unsigned short int ch, bool on);
+	bool WriteChannel(const std::string& dir, const ScanJob& job, unsigned short int ch, const std::vector<IVPoint>& points);
+	void Emit(ProgressKind kind, unsigned short int ch, double V = 0, double I = 0, bool ok = true);
+
+	static std::string DefaultBasePath();
+};
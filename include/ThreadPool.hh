@@ -0,0 +1,69 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   ThreadPool.hh
+///
+///   This class runs tasks on a few threads of its own, first posted
+///   first started. Ordering between tasks is up to the caller.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+#pragma once
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <vector>
+
+
+
+///-----------------------------------------------------------------------------
+/// Class declaration
+///-----------------------------------------------------------------------------
+class ThreadPool
+{
+	public:
+	//----------------------------------------------------------
+	// Constructors & destructor
+	//----------------------------------------------------------
+	ThreadPool() = default;
+	~ThreadPool();
+
+
+	//----------------------------------------------------------
+	// Public methods
+	//----------------------------------------------------------
+	void Start(unsigned int threads);
+	void Stop();  // Tasks not started yet are dropped
+
+	void Post(std::function<void()> task);
+
+
+	private:
+	//----------------------------------------------------------
+	// Private members
+	//----------------------------------------------------------
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::deque<std::function<void()>> tasks;
+	bool stopping = false;
+
+
+	//----------------------------------------------------------
+	// Private methods
+	//----------------------------------------------------------
+	void Run();
+};
@@ -0,0 +1,87 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   VoltageStepper.hh
+///
+///   This class hands out the voltages of one channel's sweep.
+///
+///   Fixed stepping walks ScanJob::Voltages(). Adaptive stepping starts
+///   with Vstep and rescales the step after every point so that each
+///   step moves log|I| by about the same amount: wide where the curve is
+///   flat, fine where it rises or bends. The step stays within VstepMin
+///   and VstepMax, and catches up within VstepMax so that the sweep
+///   reaches Vend within maxPoints. If the budget runs out first, the
+///   sweep stops short of Vend and the channel is not Finished.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+#pragma once
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include <vector>
+#include <optional>
+
+#include "ScanJob.hh"
+
+
+
+///-----------------------------------------------------------------------------
+/// Class declaration
+///-----------------------------------------------------------------------------
+class VoltageStepper
+{
+	public:
+	//----------------------------------------------------------
+	// Constructors & destructor
+	//----------------------------------------------------------
+	explicit VoltageStepper(const ScanJob& job);
+
+
+	//----------------------------------------------------------
+	// Public methods
+	//----------------------------------------------------------
+	// Next set point, none once Vend is handed out
+	std::optional<double> Next();
+
+	// Point measured at the last set point
+	void Feed(double V, double I);
+
+	// Vend measured?
+	bool Finished() const { return last && fed == count; }
+
+
+	private:
+	//----------------------------------------------------------
+	// Private members
+	//----------------------------------------------------------
+	bool adaptive;
+	double Vstart;
+	double Vend;
+	double dir;
+	double VstepMin;
+	double VstepMax;
+	size_t limit;                // Points per channel
+	std::vector<double> fixed;
+
+	size_t count;                // Set points handed out
+	size_t fed;                  // Points measured
+	bool last;
+	double setV;
+	double step;
+
+	// Previous point, in decades of current
+	bool havePrev;
+	double prevV;
+	double prevL;
+	bool haveSlope;
+	double prevSlope;            // Decades per volt
+};
@@ -22,12 +22,24 @@
 #include <thread>
 #include <atomic>
 #include <mutex>
-#include <unordered_set>
+#include <chrono>
+#include <unordered_map>
+#include <set>
+#include <map>
+#include <deque>
+#include <memory>
 #include <string>
+#include <optional>
+#include <vector>
+#include <cstdint>
 
 #include "global.hh"
 #include "SerialManager.hh"
 #include "PinGrid.hh"
+#include "LiveCurve.hh"
+#include "OutboundQueue.hh"
+#include "MpscQueue.hh"
+#include "ThreadPool.hh"
 
 
 
@@ -40,6 +52,22 @@ struct lws_context;
 
 
 
+///-----------------------------------------------------------------------------
+/// What a client can subscribe to. Each is one bit of the client's mask.
+///-----------------------------------------------------------------------------
+enum class Topic : std::uint32_t
+{
+	State,         // Full pin state
+	StateDelta,    // Pins changed since the last state
+	SerialRaw,     // Firmware lines as read
+	ScanLog,       // Job notices and scan script output
+	ScanProgress,  // Progress and heatmap
+	Metrics,       // Timing record of a finished job
+	Count
+};
+
+
+
 ///-----------------------------------------------------------------------------
 /// Class declaration
 ///-----------------------------------------------------------------------------
@@ -59,14 +87,36 @@ class WebSocketServer
 	bool Start(int port = 3000);
 	void Stop();
 
+	// permessage-deflate level 1-9 (0: off) and window bits 9-15. Set before Start.
+	void SetCompression(int level, int windowBits);
+
+	// At most one pin state message per client per interval (0: every change)
+	void SetStateInterval(int ms) { stateInterval = std::chrono::milliseconds(ms); }
+
+	// Threads running client commands. Set before Start.
+	void SetCommandThreads(unsigned int n) { commandThreads = n; }
+
 	void ServerLoop();
 
 	void OnClientConnected(lws* wsi);
 	void OnClientDisconnected(lws* wsi);
-	void OnClientMessage(lws* wsi, const std::string& msg);
+	void OnClientReceive(lws* wsi, const char* data, size_t len, bool final, bool binary);
+	int OnClientWritable(lws* wsi);  // -1 closes the connection
+	void OnWake();
+	void OnTick();
+
+	// Outgoing messages go through the lock-free outbox to the service
+	// thread, which queues them per client and writes them. These may be
+	// called from any thread.
 	void BroadcastState();
-	void SendToClient(lws* wsi, const std::string& msg);
-	void Deliver(const std::string& msg);
+	void SendToClient(lws* wsi, const std::string& msg, bool binary = false);
+	void Deliver(Topic topic, const std::string& msg, Backlog backlog = Backlog::Keep, const std::string& key = "");
+	void DeliverCurve(const CurveFrame& frame);
+
+	// Does any client take the topic? Lets publishers skip building messages.
+	bool Wants(Topic topic) const { return wanted . load(std::memory_order_relaxed) & Bit(topic); }
+
+	static constexpr std::uint32_t Bit(Topic topic) { return 1u << static_cast<std::uint32_t>(topic); }
 	bool IsIPAllowed(const char* ipStr);
 
 
@@ -76,11 +126,132 @@ class WebSocketServer
 	//----------------------------------------------------------
 	std::thread serverThread;
 	std::atomic<bool> isRunning{false};
-	lws_context* context = nullptr;
+	std::atomic<lws_context*> context{nullptr};
 	
 	SerialManager* serial;
 	PinGrid* pinGrid;
 
-	std::mutex clientMutex;
-	std::unordered_set<lws*> clients;  // active client connections
+	int deflateLevel = 6;
+	int deflateWindow = 12;
+	std::chrono::milliseconds stateInterval{100};
+	unsigned int commandThreads = 2;
+
+	// Client commands run here, off the service thread
+	ThreadPool workers;
+
+	// What a new client gets until it says otherwise: everything it used to
+	static constexpr std::uint32_t kDefaultTopics = (1u << static_cast<std::uint32_t>(Topic::State))
+	                                              | (1u << static_cast<std::uint32_t>(Topic::SerialRaw))
+	                                              | (1u << static_cast<std::uint32_t>(Topic::ScanLog))
+	                                              | (1u << static_cast<std::uint32_t>(Topic::ScanProgress));
+
+	// Union of the client masks, kept by the service thread
+	std::atomic<std::uint32_t> wanted{0};
+
+	// Per client, from the subprotocol it asked for
+	enum class Encoding
+	{
+		Json,    // "ws"
+		Cbor,    // "ws.cbor"
+		MsgPack  // "ws.msgpack"
+	};
+
+	// Live curve subscription. stride grows while the client lags
+	// behind and shrinks back once it keeps up.
+	struct LiveSubscription
+	{
+		bool all = true;                        // Every channel
+		std::set<unsigned short int> channels;
+		unsigned int every = 1;                 // Client's own decimation
+		unsigned int stride = 1;                // Effective decimation
+	};
+
+	// Client command on its way through a worker; see Execute
+	struct Command;
+
+	struct Client
+	{
+		std::uint64_t serial = 0;               // Tells a reused wsi from its predecessor
+		OutboundQueue queue;
+		bool kick = false;                      // Too slow, close at the next chance
+		std::chrono::steady_clock::time_point slowSince;
+		bool slow = false;
+		std::optional<LiveSubscription> live;
+		Encoding encoding = Encoding::Json;
+		std::string rx;                         // Fragments of the message coming in
+		bool rxOverflow = false;                // Too big, skipping to its end
+
+		// Commands in arrival order; one at a time runs on a worker
+		std::deque<std::shared_ptr<Command>> commands;
+		bool busy = false;
+		std::uint32_t topics = kDefaultTopics;
+
+		// Pin state rate limit
+		std::optional<std::chrono::milliseconds> stateInterval;  // Own choice over the default
+		std::chrono::steady_clock::time_point lastState;
+		bool stateDue = false;                  // A newer state waits for the interval
+	};
+	std::unordered_map<lws*, Client> clients;   // active client connections, service thread only
+	std::uint64_t nextSerial = 1;
+
+	// Published from any thread, fanned out by the service thread
+	struct Publication
+	{
+		lws* wsi = nullptr;                     // nullptr: every client taking the topic
+		Topic topic = Topic::Count;
+		OutboundMessage message;
+		std::optional<CurveFrame> curve;        // Live points, encoded per client
+		std::uint64_t serial = 0;               // With wsi: that connection only, 0 for any
+		std::shared_ptr<Command> done;          // Command back from a worker
+	};
+	MpscQueue<Publication> outbox;
+
+	// Receive buffers of closed connections, for new ones, and
+	// finished commands with their buffers. Service thread only.
+	std::vector<std::string> rxPool;
+	std::vector<std::shared_ptr<Command>> commandPool;
+
+	// Newest pin state, sent to rate limited clients when their turn comes
+	std::optional<OutboundMessage> latestState;
+
+	// Pins as last broadcast, for the deltas
+	std::mutex deltaMutex;
+	std::vector<bool> lastPins;
+
+
+	//----------------------------------------------------------
+	// Private methods
+	//----------------------------------------------------------
+	void Publish(Publication p);
+	void UpdateWanted();
+
+	// Commands
+	void RunNext(Client& client);
+	void Execute(Command& c);
+	void Finish(std::shared_ptr<Command> c);
+	void Reply(Command& c);
+	void Send(const Command& c, const std::string& msg);
+
+	// Command handlers. false with Command::error set on failure.
+	bool CmdSet(Command& c);
+	bool CmdGet(Command& c);
+	bool CmdScan(Command& c);
+	bool CmdSchema(Command& c);
+	bool CmdJobs(Command& c);
+	bool CmdProgress(Command& c);
+	bool CmdWorker(Command& c);
+	bool CmdHistory(Command& c);
+	bool CmdRate(Command& c);
+	bool CmdHeatmap(Command& c);
+	bool CmdCurve(Command& c);
+	bool CmdLive(Command& c);
+	bool CmdSubscribe(Command& c);
+	bool CmdCancel(Command& c);
+	bool CmdCheckpoints(Command& c);
+	bool CmdResume(Command& c);
+	bool CmdReorder(Command& c);
+	void Enqueue(Client& client, OutboundMessage m);
+	OutboundMessage Encode(const OutboundMessage& m, Encoding e, std::map<Encoding, OutboundMessage>& encoded);
+	void EnqueueState(Client& client, std::map<Encoding, OutboundMessage>& encoded);
+	void EnqueueCurve(Client& client, const CurveFrame& frame, std::map<unsigned int, std::shared_ptr<Payload>>& encoded);
 };
@@ -36,6 +36,7 @@ enum exit_code
 	SUCCESS           =   0,
 	TERM_SIGNAL       =   1,
 	ERROR_SERIAL_CONN =   2,
+	ERROR_SMU_SPEC    =   3,
 	ERROR_UNKNOWN     = 100
 };
 unsigned short int gVerbose = 0;
@@ -89,15 +90,34 @@ int main(int argc, char **argv)
 	// Option containers
 	//--------------------------------------
 	char* dev_switch = "/dev/ttyACM0";
+	const char* scan_script = "/sw/kulgadd/dev/source/scripts/iv_all.py";
+	const char* dev_smu     = "/dev/ttyUSB0";
+	const char* data_dir    = "/var/lib/kulgadd";
+	int bench_runs    = 0;
+	int worker_jobs   = -1;  // No warm worker
+	double ref_voltage = -100;  // Leakage map voltage
+	int deflate_level  = 6;     // permessage-deflate, 0: off
+	int deflate_window = 12;
+	int state_interval = 100;   // ms between pin state messages per client
+	int cmd_threads    = 2;     // Threads running client commands
 
 	//--------------------------------------
 	// Option dictionary
 	//--------------------------------------
-	const char* const short_options = "hv:s:";
+	const char* const short_options = "hv:s:p:m:d:w:r:z:i:c:b:";
 	const struct option long_options[] = {
 		{"help"    , 0, NULL, 'h'},
 		{"verbose" , 1, NULL, 'v'},
 		{"switch"  , 1, NULL, 's'},
+		{"script"  , 1, NULL, 'p'},
+		{"smu"     , 1, NULL, 'm'},
+		{"datadir" , 1, NULL, 'd'},
+		{"worker"  , 1, NULL, 'w'},
+		{"vref"    , 1, NULL, 'r'},
+		{"deflate" , 1, NULL, 'z'},
+		{"state-interval", 1, NULL, 'i'},
+		{"cmd-threads", 1, NULL, 'c'},
+		{"bench-spawn", 1, NULL, 'b'},
 		{NULL      , 0, NULL,   0}
 	};
 
@@ -125,6 +145,42 @@ int main(int argc, char **argv)
 				dev_switch = strdup(optarg);
 				break;
 
+			case 'p':
+				scan_script = strdup(optarg);
+				break;
+
+			case 'm':
+				dev_smu = strdup(optarg);
+				break;
+
+			case 'd':
+				data_dir = strdup(optarg);
+				break;
+
+			case 'w':
+				worker_jobs = atoi(optarg);
+				break;
+
+			case 'r':
+				ref_voltage = atof(optarg);
+				break;
+
+			case 'z':
+				if ( sscanf(optarg, "%d:%d", &deflate_level, &deflate_window) < 1 ) print_help();
+				break;
+
+			case 'i':
+				state_interval = atoi(optarg);
+				break;
+
+			case 'c':
+				cmd_threads = atoi(optarg);
+				break;
+
+			case 'b':
+				bench_runs = atoi(optarg);
+				break;
+
 			case '?':
 				print_help();
 				break;
@@ -146,6 +202,16 @@ int main(int argc, char **argv)
 	// but later will be searched automatically by finding raspberry pi pico
 
 
+	//----------------------------------------------------------
+	// Spawn benchmark: measure and quit
+	//----------------------------------------------------------
+	if ( bench_runs > 0 )
+	{
+		ScanManager::BenchmarkSpawn({ "python3", scan_script, "--help" }, bench_runs);
+		return SUCCESS;
+	}
+
+
 	//----------------------------------------------------------
 	// Open serial
 	//----------------------------------------------------------
@@ -178,8 +244,15 @@ int main(int argc, char **argv)
 	// Define scan manager
 	//----------------------------------------------------------
 	gScan = new ScanManager();
-	// The script hardcoded, but will be modified later
-	gScan -> SetCMD("python3 /sw/kulgadd/dev/source/scripts/iv_all.py --Vstart 0 --Vend -50 --Vstep 1 --sensorname w5a --Icompliance 1e-5");
+	gScan -> SetScript(scan_script);
+	if ( !gScan -> SetSMU(dev_smu) )
+	{
+		std::cerr << "[kumtdd::main] Invalid SMU specification " << dev_smu << std::endl;
+		return ERROR_SMU_SPEC;
+	}
+	gScan -> SetReferenceVoltage(ref_voltage);
+	gScan -> SetDataDir(data_dir);
+	if ( worker_jobs >= 0 ) gScan -> StartWorker(worker_jobs);
 
 
 	//----------------------------------------------------------
@@ -188,6 +261,9 @@ int main(int argc, char **argv)
 	try
 	{
 		gServer = new WebSocketServer(gSerial, gGrid);
+		gServer -> SetCompression(deflate_level, deflate_window);
+		gServer -> SetStateInterval(state_interval);
+		gServer -> SetCommandThreads(cmd_threads);
 		gServer -> Start();
 		while ( ! terminateRequested )
 		{
@@ -228,4 +304,13 @@ void print_help()
 	std::cout << "Options:" << std::endl;
 	std::cout << "  -v, --verbose  Set verbose level"                              << std::endl;
 	std::cout << "  -s, --switch   Manually designate switching matrix controller" << std::endl;
+	std::cout << "  -p, --script   Path of the IV scan script"                     << std::endl;
+	std::cout << "  -m, --smu      Source-meters for native sweeps (tty or tcp://host:port), comma separated, each optionally @first-last matrix row" << std::endl;
+	std::cout << "  -d, --datadir  Directory of the IV result stores"             << std::endl;
+	std::cout << "  -w, --worker N Keep a warm scan worker, recycled after N jobs (0: never)" << std::endl;
+	std::cout << "  -r, --vref V   Voltage of the per-pad leakage map (default -100)" << std::endl;
+	std::cout << "  -z, --deflate L[:W]  WebSocket compression level 1-9 (0: off) and window bits 9-15 (default 6:12)" << std::endl;
+	std::cout << "  -i, --state-interval MS  At most one pin state message per client every MS (default 100, 0: every change)" << std::endl;
+	std::cout << "  -c, --cmd-threads N  Threads running client commands, off the WebSocket thread (default 2)" << std::endl;
+	std::cout << "  -b, --bench-spawn N  Measure scan script spawn-to-first-output latency over N runs and exit" << std::endl;
 }
@@ -8,11 +8,121 @@ import numpy as np
 from ast import literal_eval
 from collections.abc import Iterable
 
+import json
 import lgad_ivcv
 from lgad_ivcv.ivcv import iv_sw
 
-def measure_all(smport, v0, v1, dv, Icomp, basepath, sensor_name, channels=[], return_swp=False, dryrun=False):
+
+class Progress:
+    """JSON-lines progress events for kulgadd, on the fd it passes in
+    KULGADD_PROGRESS_FD. Does nothing when run by hand."""
+
+    def __init__(self, out=None):
+        fd = os.environ.get("KULGADD_PROGRESS_FD")
+        self.out = out
+        if out is None and fd is not None:
+            try:
+                self.out = os.fdopen(int(fd), "w", buffering=1)
+            except OSError:
+                self.out = None
+
+    def emit(self, ev, ch, **kw):
+        if self.out is None:
+            return
+        msg = {"ev": ev, "ch": ch, "t": time.time()}
+        msg.update(kw)
+        try:
+            self.out.write(json.dumps(msg) + "\n")
+        except OSError:
+            self.out = None
+
+    def channel_start(self, ch):
+        self.emit("channel_start", ch)
+
+    def channel_end(self, ch, ok=True):
+        if ok:
+            self.emit("channel_end", ch)
+        else:
+            self.emit("channel_end", ch, ok=False)
+
+    def step(self, ch, V, I):
+        self.emit("step", ch, V=V, I=I)
+
+    def compliance(self, ch, V, I):
+        self.emit("compliance", ch, V=V, I=I)
+
+
+class PointHook:
+    """Reports every V,I reading of the SMU as a step event, and the ones
+    at the current limit as compliance. It wraps the query method of the
+    instrument objects iv_sw holds, so iv_sw itself needs no change.
+
+    lgad_ivcv does its own measurement loop, so this is the one place the
+    points pass through. What the hook relies on:
+      - IV_sw keeps its SMU as an attribute with a pyvisa-style
+        query(cmd) method, and reads points through it;
+      - the SMU answers :READ?/:MEAS? with "V,I" (FORM:ELEM VOLT,CURR).
+    Should lgad_ivcv change either, the hook says so on stderr instead of
+    leaving the daemon without points: when it finds nothing to wrap, and
+    when a channel ends without a single point."""
+
+    READS = (":READ", "READ", ":MEAS", "MEAS")
+
+    def __init__(self, progress, Icomp):
+        self.progress = progress
+        self.Icomp = Icomp
+        self.ch = None
+        self.points = 0
+
+    def attach(self, ivsw):
+        hooked = 0
+        for obj in list(vars(ivsw).values()):
+            query = getattr(obj, "query", None)
+            if callable(query) and not getattr(query, "kulgadd_hook", False):
+                try:
+                    setattr(obj, "query", self.wrap(query))
+                    hooked += 1
+                except (AttributeError, TypeError):
+                    pass
+        if hooked == 0:
+            print("[iv_all] No instrument with a query method in IV_sw; "
+                  "the daemon gets channel boundaries but no points", file=sys.stderr)
+        return hooked
+
+    def start(self, ch):
+        self.ch = ch
+        self.points = 0
+
+    def end(self):
+        if self.ch is not None and self.points == 0:
+            print(f"[iv_all] Channel {self.ch}: no V,I reading went through the hook", file=sys.stderr)
+        self.ch = None
+
+    def wrap(self, query):
+        def hooked(cmd, *args, **kwargs):
+            reply = query(cmd, *args, **kwargs)
+            if self.ch is not None and str(cmd).strip().upper().startswith(self.READS):
+                self.point(reply)
+            return reply
+        hooked.kulgadd_hook = True
+        return hooked
+
+    def point(self, reply):
+        # FORM:ELEM VOLT,CURR: "V,I"
+        try:
+            V, I = [float(x) for x in str(reply).strip().split(",")[:2]]
+        except ValueError:
+            return
+        self.points += 1
+        self.progress.step(self.ch, V, I)
+        if abs(I) >= 0.999 * self.Icomp:
+            self.progress.compliance(self.ch, V, I)
+
+
+def measure_all(smport, v0, v1, dv, Icomp, basepath, sensor_name, channels=[], return_swp=False, dryrun=False, progress=None, nchannels=256):
     ivsw = iv_sw.IV_sw(smport, dryrun)
+    if progress is None:
+        progress = Progress()
 
     ivsw.set_smu()
     ivsw.set_pau()
@@ -21,15 +131,36 @@ def measure_all(smport, v0, v1, dv, Icomp, basepath, sensor_name, channels=[], r
     ivsw.set_sweep(v0, v1, dv, return_swp)
     ivsw.set_compliance(Icomp)
 
-    if len(channels) == 0:
+    if len(channels) == 0 and progress.out is None:
         ivsw.measure_all_channels()
+    elif len(channels) > 0 and isinstance(channels[0], Iterable):
+        ivsw.measure_coord(channels)
+    elif progress.out is None:
+        ivsw.measure_channel(channels)
     else:
-        if isinstance(channels[0], Iterable):
-            ivsw.measure_coord(channels)
-        else:
-            ivsw.measure_channel(channels)
+        # One channel at a time so the daemon sees channel boundaries and points
+        hook = PointHook(progress, Icomp)
+        hook.attach(ivsw)
+        for ch in (channels if len(channels) > 0 else range(nchannels)):
+            progress.channel_start(ch)
+            hook.start(ch)
+            try:
+                ivsw.measure_channel([ch])
+                hook.end()
+            except Exception:
+                # Not done: a resume measures it again
+                progress.channel_end(ch, ok=False)
+                raise
+            finally:
+                hook.ch = None
+            progress.channel_end(ch)
     
 
+def default_basepath():
+    now = datetime.datetime.now().isoformat()
+    return f"../../result/{now[:10]}/{now.split('.')[0].replace(':','')}"
+
+
 def main():
     parser = argparse.ArgumentParser(description="")
     parser.add_argument('items',        nargs="*",      default=[],     help="Channel numbers") 
@@ -42,6 +173,7 @@ def main():
     parser.add_argument('--dryrun',     required=False, action="store_true", help="Dry run with only switching matrix operation")
     parser.add_argument('-p', '--port', required=False, default='ws://localhost:3001', help="Switching matrix port")
     parser.add_argument('-I', '--Icompliance', required=False, default=1e-5, help="SMU current compliance")
+    parser.add_argument('--nchannels', required=False, default=256, help="Channels of the matrix, for an empty channel list")
 
     args = parser.parse_args()
 
@@ -58,13 +190,9 @@ def main():
     return_swp = args.return_swp
     dryrun = args.dryrun
 
-    if args.basepath == None:
-        now = datetime.datetime.now().isoformat()
-        basepath = f"../../result/{now[:10]}/{now.split('.')[0].replace(':','')}"
-    else:
-        args.basepath = basepath
+    basepath = default_basepath() if args.basepath == None else args.basepath
 
-    measure_all(port, v0, v1, dv, Icomp, basepath, sensor_name, channels, return_swp, dryrun)
+    measure_all(port, v0, v1, dv, Icomp, basepath, sensor_name, channels, return_swp, dryrun, nchannels=int(args.nchannels))
 
 if __name__=="__main__":
     main()
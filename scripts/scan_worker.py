@@ -0,0 +1,74 @@
+"""Long-lived scan worker for kulgadd.
+
+Imports the measurement stack once, then takes jobs from the daemon over
+the Unix socket on KULGADD_WORKER_FD. One JSON line per request:
+
+    {"cmd": "run", "job": {...}, "nchannels": n}
+                                   run a scan job (ScanJob JSON) on a
+                                   matrix of n channels
+    {"cmd": "quit"}                exit
+
+Progress events go back on the same socket, in the format of iv_all.py,
+followed by {"ev": "job_end", "job": id, "ok": bool, "error": str|null}.
+SIGINT aborts the running job; the worker stays up for the next one.
+"""
+
+import os
+import sys
+import json
+import traceback
+
+import iv_all  # numpy and lgad_ivcv, once
+
+
+def run(job, progress, nchannels):
+    channels = job.get("channels", [])
+    basepath = job.get("basepath") or iv_all.default_basepath()
+    iv_all.measure_all('ws://localhost:3001',
+                       float(job.get("Vstart", 0)), float(job.get("Vend", -10)), float(job.get("Vstep", 1)),
+                       float(job.get("Icompliance", 1e-5)), basepath, job.get("sensorname", "test"),
+                       channels, False, job.get("mode") == "dryrun", progress, nchannels)
+
+
+def main():
+    fd = int(os.environ.get("KULGADD_WORKER_FD", "3"))
+    rfile = os.fdopen(fd, "r")
+    wfile = os.fdopen(os.dup(fd), "w", buffering=1)
+    progress = iv_all.Progress(wfile)
+
+    def send(msg):
+        wfile.write(json.dumps(msg) + "\n")
+
+    send({"ev": "ready", "pid": os.getpid()})
+
+    while True:
+        try:
+            line = rfile.readline()
+        except KeyboardInterrupt:
+            continue  # Abort while idle
+        if not line:
+            break
+
+        try:
+            req = json.loads(line)
+        except ValueError:
+            continue
+        if req.get("cmd") == "quit":
+            break
+        if req.get("cmd") != "run":
+            continue
+
+        job = req.get("job", {})
+        ok, error = True, None
+        try:
+            run(job, progress, int(req.get("nchannels", 256)))
+        except KeyboardInterrupt:
+            ok, error = False, "aborted"
+        except Exception as e:
+            ok, error = False, repr(e)
+            traceback.print_exc()
+        send({"ev": "job_end", "job": job.get("id"), "ok": ok, "error": error})
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,84 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   BreakdownDetector.cc
+///
+///   The definition of BreakdownDetector class.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include <cmath>
+
+#include "BreakdownDetector.hh"
+
+
+
+///-----------------------------------------------------------------------------
+/// Constructors and destructors
+///-----------------------------------------------------------------------------
+BreakdownDetector::BreakdownDetector(const ScanJob& job)
+	: rule(job . stopRule), Icompliance(job . Icompliance), slopeLimit(job . slopeLimit), slopePoints(job . slopePoints)
+{
+	Reset();
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Methods
+///-----------------------------------------------------------------------------
+///-----------------------------------------------
+/// New channel
+///-----------------------------------------------
+void BreakdownDetector::Reset()
+{
+	havePrev = false;
+	prevV    = 0;
+	prevI    = 0;
+	steep    = 0;
+	reason   = "";
+}
+
+
+///-----------------------------------------------
+/// Apply the rule to the next point
+///-----------------------------------------------
+bool BreakdownDetector::Feed(double V, double I)
+{
+	if ( rule == StopRule::None ) return false;
+
+	// Same margin as the compliance event
+	if ( (rule == StopRule::Compliance || rule == StopRule::Any) && std::abs(I) >= 0.999 * Icompliance )
+	{
+		reason = "compliance";
+		return true;
+	}
+
+	if ( rule == StopRule::Slope || rule == StopRule::Any )
+	{
+		if ( havePrev && V != prevV )
+		{
+			double slope = std::abs((I - prevI) / (V - prevV));
+			steep = slope > slopeLimit ? steep + 1 : 0;
+		}
+		havePrev = true;
+		prevV = V;
+		prevI = I;
+
+		if ( steep >= slopePoints )
+		{
+			reason = "slope";
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,142 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   LiveCurve.cc
+///
+///   The definition of LiveCurve class.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include <cstring>
+
+#include "LiveCurve.hh"
+
+
+
+///-----------------------------------------------------------------------------
+/// Anonymous namespace
+///-----------------------------------------------------------------------------
+namespace
+{
+	// Flush a channel at this many points or this age, whichever comes first
+	constexpr size_t kFramePoints = 32;
+	constexpr std::chrono::milliseconds kFrameAge(200);
+
+	constexpr size_t kHeaderSize = 12;
+
+	template <typename T>
+	void Put(std::string& out, T v)
+	{
+		char b[sizeof(T)];
+		std::memcpy(b, &v, sizeof(T));
+		out . append(b, sizeof(T));
+	}
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Constructors and destructors
+///-----------------------------------------------------------------------------
+LiveCurve::LiveCurve() : job(0)
+{
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Methods
+///-----------------------------------------------------------------------------
+///-----------------------------------------------
+/// New job
+///-----------------------------------------------
+void LiveCurve::Begin(unsigned int j)
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	job = j;
+	pending . clear();
+}
+
+
+void LiveCurve::End()
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	pending . clear();
+}
+
+
+///-----------------------------------------------
+/// Collect a point, hand out a frame when due
+///-----------------------------------------------
+std::optional<CurveFrame> LiveCurve::Apply(const ProgressEvent& ev)
+{
+	if ( ev . kind != ProgressKind::Step && ev . kind != ProgressKind::ChannelEnd ) return std::nullopt;
+
+	std::lock_guard<std::mutex> lk(mutex);
+	auto now = std::chrono::steady_clock::now();
+	bool last = (ev . kind == ProgressKind::ChannelEnd);
+
+	auto it = pending . find(ev . ch);
+	if ( it == pending . end() )
+	{
+		if ( last ) return std::nullopt;
+		it = pending . emplace(ev . ch, Pending()) . first;
+	}
+
+	Pending& p = it -> second;
+	if ( !last )
+	{
+		if ( p . VI . empty() ) p . since = now;
+		p . VI . push_back(static_cast<float>(ev . V));
+		p . VI . push_back(static_cast<float>(ev . I));
+		if ( p . VI . size() / 2 < kFramePoints && now - p . since < kFrameAge ) return std::nullopt;
+	}
+
+	CurveFrame f;
+	f . job  = job;
+	f . ch   = ev . ch;
+	f . seq  = p . seq;
+	f . VI   = std::move(p . VI);
+	f . last = last;
+
+	p . seq += f . VI . size() / 2;
+	p . VI . clear();
+	if ( last ) pending . erase(it);
+	return f;
+}
+
+
+///-----------------------------------------------
+/// Binary frame
+///-----------------------------------------------
+std::string LiveCurve::Encode(const CurveFrame& f, unsigned int stride)
+{
+	if ( stride == 0 ) stride = 1;
+	size_t n = f . VI . size() / 2;
+
+	std::string out;
+	out . reserve(kHeaderSize + f . VI . size() * sizeof(float));
+	Put<uint8_t>(out, kFrameCurve);
+	Put<uint8_t>(out, f . last ? 1 : 0);
+	Put<uint16_t>(out, f . ch);
+	Put<uint32_t>(out, f . job);
+	Put<uint32_t>(out, f . seq);
+
+	for ( size_t i = 0; i < n; i++ )
+	{
+		// Decimate on the channel's point index, so frames line up
+		bool keep = ((f . seq + i) % stride == 0) || (f . last && i + 1 == n);
+		if ( !keep ) continue;
+		Put<float>(out, f . VI[2 * i]);
+		Put<float>(out, f . VI[2 * i + 1]);
+	}
+	return out;
+}
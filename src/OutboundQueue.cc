@@ -0,0 +1,112 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   OutboundQueue.cc
+///
+///   The definition of OutboundQueue class.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include "OutboundQueue.hh"
+
+
+
+///-----------------------------------------------------------------------------
+/// Constructors and destructors
+///-----------------------------------------------------------------------------
+OutboundQueue::OutboundQueue(size_t maxMessages_, size_t maxBytes_)
+	: maxMessages(maxMessages_), maxBytes(maxBytes_), bytes(0), dropped(0)
+{
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Public methods
+///-----------------------------------------------------------------------------
+///-----------------------------------------------
+/// Queue a message
+///-----------------------------------------------
+bool OutboundQueue::Push(OutboundMessage m)
+{
+	//--------------------------------------
+	// A newer snapshot makes the queued one stale
+	//--------------------------------------
+	if ( m . backlog == Backlog::Replace )
+	{
+		for ( auto it = queue . begin(); it != queue . end(); ++it )
+		{
+			if ( it -> backlog == Backlog::Replace && it -> key == m . key )
+			{
+				bytes -= it -> payload -> Size();
+				queue . erase(it);
+				break;
+			}
+		}
+	}
+
+	//--------------------------------------
+	// Make room by giving up the oldest deltas
+	//--------------------------------------
+	auto it = queue . begin();
+	while ( !Fits(m . payload -> Size()) && it != queue . end() )
+	{
+		if ( it -> backlog == Backlog::Drop )
+		{
+			bytes -= it -> payload -> Size();
+			it = queue . erase(it);
+			dropped++;
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	if ( !Fits(m . payload -> Size()) )
+	{
+		if ( m . backlog != Backlog::Drop ) return false;
+		dropped++;
+		return true;
+	}
+
+	bytes += m . payload -> Size();
+	queue . push_back(std::move(m));
+	return true;
+}
+
+
+///-----------------------------------------------
+/// Next message to write
+///-----------------------------------------------
+std::optional<OutboundMessage> OutboundQueue::Pop()
+{
+	if ( queue . empty() ) return std::nullopt;
+
+	OutboundMessage m = std::move(queue . front());
+	queue . pop_front();
+	bytes -= m . payload -> Size();
+	return m;
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Private methods
+///-----------------------------------------------------------------------------
+///-----------------------------------------------
+/// Room for one more? A lone message always fits.
+///-----------------------------------------------
+bool OutboundQueue::Fits(size_t size) const
+{
+	if ( queue . empty() ) return true;
+	return queue . size() < maxMessages && bytes + size <= maxBytes;
+}
@@ -0,0 +1,254 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   PadSummary.cc
+///
+///   The definition of PadSummary class.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+
+#include "global.hh"
+#include "PadSummary.hh"
+
+
+
+///-----------------------------------------------------------------------------
+/// JSON namespace
+///-----------------------------------------------------------------------------
+using json = nlohmann::json;
+
+
+
+///-----------------------------------------------------------------------------
+/// Constructors and destructors
+///-----------------------------------------------------------------------------
+PadSummary::PadSummary() : rows(16), cols(16), Vref(-100), active(false), job(0), pads(rows * cols)
+{
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Methods
+///-----------------------------------------------------------------------------
+///-----------------------------------------------
+/// Grid geometry
+///-----------------------------------------------
+void PadSummary::SetGeometry(unsigned short int r, unsigned short int c)
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	if ( r == rows && c == cols ) return;
+
+	rows = r;
+	cols = c;
+	pads . assign(rows * cols, Pad());
+}
+
+
+///-----------------------------------------------
+/// Voltage of the leakage map
+///-----------------------------------------------
+void PadSummary::SetReference(double V)
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	if ( V == Vref ) return;
+
+	// Old leakage values belong to another voltage
+	Vref = V;
+	for ( auto& p : pads ) p . leakage . reset();
+}
+
+
+///-----------------------------------------------
+/// Job start and end
+///-----------------------------------------------
+void PadSummary::Begin(unsigned int j)
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	active = true;
+	job = j;
+	open . clear();
+}
+
+
+void PadSummary::End()
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	active = false;
+	open . clear();
+}
+
+
+///-----------------------------------------------
+/// Follow the channels of the running job
+///-----------------------------------------------
+bool PadSummary::Apply(const ProgressEvent& ev)
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	if ( !active ) return false;
+
+	switch ( ev . kind )
+	{
+		case ProgressKind::ChannelStart:
+			open[ev . ch] = OpenPad();
+			break;
+
+		case ProgressKind::Step:
+		{
+			auto it = open . find(ev . ch);
+			if ( it == open . end() ) break;
+			OpenPad& o = it -> second;
+
+			// Leakage where the sweep passes Vref, interpolated between the two points around it
+			if ( !o . leakage )
+			{
+				if ( ev . V == Vref )
+				{
+					o . leakage = ev . I;
+				}
+				else if ( o . points > 0 && (o . prevV - Vref) * (ev . V - Vref) < 0 )
+				{
+					o . leakage = o . prevI + (ev . I - o . prevI) * (Vref - o . prevV) / (ev . V - o . prevV);
+				}
+			}
+			o . prevV = ev . V;
+			o . prevI = ev . I;
+			o . points++;
+			break;
+		}
+
+		// A stop rule's verdict wins over the first compliance hit
+		case ProgressKind::Compliance:
+		{
+			auto it = open . find(ev . ch);
+			if ( it != open . end() && !it -> second . breakdown ) it -> second . breakdown = ev . V;
+			break;
+		}
+
+		case ProgressKind::Breakdown:
+		{
+			auto it = open . find(ev . ch);
+			if ( it != open . end() ) it -> second . breakdown = ev . V;
+			break;
+		}
+
+		case ProgressKind::ChannelEnd:
+		{
+			auto it = open . find(ev . ch);
+			if ( it == open . end() ) break;
+			OpenPad o = it -> second;
+			open . erase(it);
+
+			// A channel cut short leaves the pad's previous result
+			if ( !ev . ok || o . points == 0 || ev . ch >= pads . size() ) break;
+			pads[ev . ch] = Pad{ job, o . leakage, o . breakdown };
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+///-----------------------------------------------
+/// JSON handling: one message for the whole sensor
+///-----------------------------------------------
+std::string PadSummary::ToJSONString()
+{
+	std::lock_guard<std::mutex> lk(mutex);
+
+	json leakage   = json::array();
+	json breakdown = json::array();
+	json jobs      = json::array();
+	for ( const auto& p : pads )
+	{
+		leakage   . push_back(p . leakage   ? json(*p . leakage)   : json(nullptr));
+		breakdown . push_back(p . breakdown ? json(*p . breakdown) : json(nullptr));
+		jobs      . push_back(p . job);
+	}
+
+	json j;
+	j["heatmap"]["rows"]      = rows;
+	j["heatmap"]["cols"]      = cols;
+	j["heatmap"]["Vref"]      = Vref;
+	j["heatmap"]["leakage"]   = leakage;
+	j["heatmap"]["breakdown"] = breakdown;
+	j["heatmap"]["job"]       = jobs;
+	return j . dump();
+}
+
+
+///-----------------------------------------------
+/// Save to a file, replacing it atomically
+///-----------------------------------------------
+bool PadSummary::Save(const std::string& path)
+{
+	std::string tmp = path + ".tmp";
+	{
+		std::ofstream out(tmp);
+		if ( !out ) return false;
+		out << ToJSONString() << "\n";
+		if ( !out ) return false;
+	}
+
+	if ( rename(tmp . c_str(), path . c_str()) != 0 )
+	{
+		std::cerr << "[kulgadd::PadSummary::Save] Cannot write " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+
+///-----------------------------------------------
+/// Load a saved map of the same geometry
+///-----------------------------------------------
+bool PadSummary::Load(const std::string& path)
+{
+	std::ifstream in(path);
+	if ( !in ) return false;
+
+	try
+	{
+		json j = json::parse(in)["heatmap"];
+
+		std::lock_guard<std::mutex> lk(mutex);
+		if ( j["rows"] != rows || j["cols"] != cols ) return false;
+		size_t n = rows * cols;
+		if ( j["job"] . size() != n || j["leakage"] . size() != n || j["breakdown"] . size() != n ) return false;
+		bool sameRef = (j["Vref"] . get<double>() == Vref);
+
+		for ( size_t i = 0; i < n; i++ )
+		{
+			Pad p;
+			p . job = j["job"][i];
+			if ( sameRef && !j["leakage"][i] . is_null() ) p . leakage   = j["leakage"][i] . get<double>();
+			if ( !j["breakdown"][i] . is_null()           ) p . breakdown = j["breakdown"][i] . get<double>();
+			pads[i] = p;
+		}
+	}
+	catch ( const std::exception& e )
+	{
+		std::cerr << "[kulgadd::PadSummary::Load] " << path << ": " << e . what() << std::endl;
+		return false;
+	}
+
+	if ( gVerbose > 1 )
+	{
+		std::cout << "[kulgadd::PadSummary::Load] " << path << std::endl;
+	}
+	return true;
+}
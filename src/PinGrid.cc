@@ -85,6 +85,7 @@ void PinGrid::Initialize(bool value)
 	//--------------------------------------
 	// Fill member vector pins with given value
 	//--------------------------------------
+	std::lock_guard<std::mutex> lock(mMutex);
 	std::fill(mPins . begin(), mPins . end(), value);
 }
 
@@ -96,6 +97,7 @@ bool PinGrid::Get(unsigned short int row, unsigned short int col) const
 {
 	if ( !IsValidCoord(row, col) ) throw std::out_of_range("[kumtdd] PinGrid::Get: Invalid row or column");
 
+	std::lock_guard<std::mutex> lock(mMutex);
 	return mPins[row * mCols + col];
 }
 
@@ -107,6 +109,7 @@ bool PinGrid::Get(unsigned short int index) const
 {
 	if ( !IsValidIndex(index) ) throw std::out_of_range("[kumtdd] PinGrid::Get: Invalid index");
 
+	std::lock_guard<std::mutex> lock(mMutex);
 	return mPins[index];
 }
 
@@ -126,6 +129,7 @@ void PinGrid::Set(unsigned short int row, unsigned short int col, bool value)
 
 	if ( !IsValidCoord(row, col) ) throw std::out_of_range("[kumtdd] PinGrid::Set: invalid row or column");
 
+	std::lock_guard<std::mutex> lock(mMutex);
 	mPins[row * mCols + col] = value;
 }
 
@@ -145,6 +149,7 @@ void PinGrid::Set(unsigned short int index, bool value)
 
 	if ( !IsValidIndex(index) ) throw std::out_of_range("[kumtdd] PinGrid::Set: Invalid index");
 
+	std::lock_guard<std::mutex> lock(mMutex);
 	mPins[index] = value;
 }
 
@@ -157,7 +162,10 @@ std::string PinGrid::ToJSONString() const
 	json j;
 	j["rows"] = mRows;
 	j["cols"] = mCols;
-	j["pins"] = mPins;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		j["pins"] = mPins;
+	}
 
 	return j . dump();
 }
@@ -178,6 +186,7 @@ bool PinGrid::FromJSONString(const std::string& jsonStr)
 		std::vector<bool> newPins = j["pins"].get<std::vector<bool>>();
 		if ( (unsigned short int) newPins . size() != r * c ) return false;
 
+		std::lock_guard<std::mutex> lock(mMutex);
 		mRows = r;
 		mCols = c;
 		mPins = std::move(newPins);
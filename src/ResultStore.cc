@@ -0,0 +1,407 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   ResultStore.cc
+///
+///   The definition of ResultStore class.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include "global.hh"
+#include "ResultStore.hh"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+#include <nlohmann/json.hpp>
+
+
+
+///-----------------------------------------------------------------------------
+/// JSON namespace
+///-----------------------------------------------------------------------------
+using json = nlohmann::json;
+
+
+
+///-----------------------------------------------------------------------------
+/// Anonymous namespace
+///-----------------------------------------------------------------------------
+namespace
+{
+	const char kMagic[8] = { 'K', 'U', 'L', 'G', 'A', 'D', 'I', 'V' };
+	constexpr uint32_t kVersion = 1;
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Constructors and destructors
+///-----------------------------------------------------------------------------
+ResultStore::ResultStore() : fd(-1), writable(false), base(nullptr), mapped(0)
+{
+	static_assert(sizeof(Header) == 64, "ResultStore header must stay 64 bytes");
+}
+
+
+ResultStore::~ResultStore()
+{
+	Close();
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Public methods
+///-----------------------------------------------------------------------------
+///---------------------------------------------------------
+/// Create a new store for writing
+///---------------------------------------------------------
+bool ResultStore::Create(const std::string& p, unsigned int job)
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	CloseLocked();
+
+	fd = open(p . c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if ( fd < 0 )
+	{
+		std::cerr << "[kulgadd::ResultStore::Create] Failed to open " << p << ": " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	writable = true;
+	path = p;
+	if ( !Map(sizeof(Header) + BlockSize()) )
+	{
+		CloseLocked();
+		return false;
+	}
+
+	Header* h = GetHeader();
+	std::memcpy(h -> magic, kMagic, sizeof(kMagic));
+	h -> version      = kVersion;
+	h -> job          = job;
+	h -> count        = 0;
+	h -> blockRecords = kBlockRecords;
+
+	if ( gVerbose > 1 )
+	{
+		std::cout << "[kulgadd::ResultStore::Create] " << p << std::endl;
+	}
+	return true;
+}
+
+
+///---------------------------------------------------------
+/// Open an existing store read only
+///---------------------------------------------------------
+bool ResultStore::Open(const std::string& p)
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	CloseLocked();
+
+	fd = open(p . c_str(), O_RDONLY | O_CLOEXEC);
+	if ( fd < 0 ) return false;
+
+	struct stat st;
+	if ( fstat(fd, &st) != 0 || static_cast<size_t>(st . st_size) < sizeof(Header) )
+	{
+		CloseLocked();
+		return false;
+	}
+
+	writable = false;
+	path = p;
+	if ( !Map(st . st_size) )
+	{
+		CloseLocked();
+		return false;
+	}
+
+	// Reject anything that is not ours or claims more than the file holds
+	Header* h = GetHeader();
+	uint64_t blocks = (h -> count + kBlockRecords - 1) / kBlockRecords;
+	if ( std::memcmp(h -> magic, kMagic, sizeof(kMagic)) != 0 || h -> version != kVersion ||
+	     h -> blockRecords != kBlockRecords || sizeof(Header) + blocks * BlockSize() > mapped )
+	{
+		std::cerr << "[kulgadd::ResultStore::Open] Not a valid store: " << p << std::endl;
+		CloseLocked();
+		return false;
+	}
+
+	RebuildIndex();
+	return true;
+}
+
+
+///---------------------------------------------------------
+/// Close
+///---------------------------------------------------------
+void ResultStore::Close()
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	CloseLocked();
+}
+
+
+bool ResultStore::IsOpen()
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	return base != nullptr;
+}
+
+
+unsigned int ResultStore::GetJob()
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	return base ? GetHeader() -> job : 0;
+}
+
+
+///---------------------------------------------------------
+/// Append one record
+///---------------------------------------------------------
+bool ResultStore::Append(unsigned short int ch, double V, double I, double t)
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	if ( !base || !writable ) return false;
+
+	uint64_t rec = GetHeader() -> count;
+	if ( sizeof(Header) + (rec / kBlockRecords + 1) * BlockSize() > mapped )
+	{
+		if ( !Grow() ) return false;
+	}
+
+	uint64_t b = rec / kBlockRecords;
+	uint64_t i = rec % kBlockRecords;
+	ChannelColumn(b)[i] = ch;
+	VoltageColumn(b)[i] = V;
+	CurrentColumn(b)[i] = I;
+	TimeColumn(b)[i]    = t;
+
+	// Count last, so a reader mapping the file never sees a half record
+	__atomic_store_n(&GetHeader() -> count, rec + 1, __ATOMIC_RELEASE);
+	Index(rec, ch);
+	return true;
+}
+
+
+///---------------------------------------------------------
+/// One channel's curve
+///---------------------------------------------------------
+bool ResultStore::GetCurve(unsigned short int ch, std::vector<double>& V, std::vector<double>& I, std::vector<double>& t)
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	V . clear();
+	I . clear();
+	t . clear();
+	if ( !base ) return false;
+
+	auto it = index . find(ch);
+	if ( it == index . end() ) return false;
+
+	for ( const auto& [begin, end] : it -> second )
+	{
+		for ( uint64_t rec = begin; rec < end; rec++ )
+		{
+			uint64_t b = rec / kBlockRecords;
+			uint64_t i = rec % kBlockRecords;
+			V . push_back(VoltageColumn(b)[i]);
+			I . push_back(CurrentColumn(b)[i]);
+			t . push_back(TimeColumn(b)[i]);
+		}
+	}
+	return true;
+}
+
+
+///---------------------------------------------------------
+/// Channels present, with their record counts
+///---------------------------------------------------------
+std::vector<std::pair<unsigned short int, size_t>> ResultStore::GetChannels()
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	std::vector<std::pair<unsigned short int, size_t>> out;
+	for ( const auto& [ch, runs] : index )
+	{
+		size_t n = 0;
+		for ( const auto& [begin, end] : runs ) n += end - begin;
+		out . emplace_back(ch, n);
+	}
+	return out;
+}
+
+
+///------------------------------------------------
+/// JSON handling: one curve
+///------------------------------------------------
+std::string ResultStore::CurveToJSONString(unsigned short int ch)
+{
+	std::vector<double> V, I, t;
+	GetCurve(ch, V, I, t);
+
+	json c;
+	c["job"] = GetJob();
+	c["ch"]  = ch;
+	c["V"]   = V;
+	c["I"]   = I;
+	c["t"]   = t;
+
+	json j;
+	j["curve"] = c;
+	return j . dump();
+}
+
+
+///------------------------------------------------
+/// JSON handling: channel list
+///------------------------------------------------
+std::string ResultStore::ChannelsToJSONString()
+{
+	json c = json::array();
+	for ( const auto& [ch, n] : GetChannels() ) c . push_back({ { "ch", ch }, { "n", n } });
+
+	json j;
+	j["curves"]["job"]      = GetJob();
+	j["curves"]["channels"] = c;
+	return j . dump();
+}
+
+
+///------------------------------------------------
+/// File name of a job's store
+///------------------------------------------------
+std::string ResultStore::PathFor(const std::string& dir, unsigned int job)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "/job%06u.ivs", job);
+	return dir + name;
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Private methods
+///-----------------------------------------------------------------------------
+///---------------------------------------------------------
+/// Column access. A block is [ch u16 | V f64 | I f64 | t f64] x kBlockRecords.
+///---------------------------------------------------------
+size_t ResultStore::BlockSize()
+{
+	return kBlockRecords * (sizeof(uint16_t) + 3 * sizeof(double));
+}
+
+uint8_t* ResultStore::Block(uint64_t b) const
+{
+	return base + sizeof(Header) + b * BlockSize();
+}
+
+uint16_t* ResultStore::ChannelColumn(uint64_t b) const
+{
+	return reinterpret_cast<uint16_t*>(Block(b));
+}
+
+double* ResultStore::VoltageColumn(uint64_t b) const
+{
+	return reinterpret_cast<double*>(Block(b) + kBlockRecords * sizeof(uint16_t));
+}
+
+double* ResultStore::CurrentColumn(uint64_t b) const
+{
+	return VoltageColumn(b) + kBlockRecords;
+}
+
+double* ResultStore::TimeColumn(uint64_t b) const
+{
+	return CurrentColumn(b) + kBlockRecords;
+}
+
+
+///---------------------------------------------------------
+/// (Re)map the file at the given size
+///---------------------------------------------------------
+bool ResultStore::Map(size_t size)
+{
+	if ( writable && ftruncate(fd, size) != 0 )
+	{
+		std::cerr << "[kulgadd::ResultStore::Map] ftruncate: " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	int prot = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+	void* m;
+	if ( base ) m = mremap(base, mapped, size, MREMAP_MAYMOVE);
+	else        m = mmap(nullptr, size, prot, MAP_SHARED, fd, 0);
+	if ( m == MAP_FAILED )
+	{
+		std::cerr << "[kulgadd::ResultStore::Map] " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	base = static_cast<uint8_t*>(m);
+	mapped = size;
+	return true;
+}
+
+
+///---------------------------------------------------------
+/// Double the number of blocks
+///---------------------------------------------------------
+bool ResultStore::Grow()
+{
+	size_t blocks = (mapped - sizeof(Header)) / BlockSize();
+	return Map(sizeof(Header) + 2 * blocks * BlockSize());
+}
+
+
+///---------------------------------------------------------
+/// Extend the channel's last run or start a new one
+///---------------------------------------------------------
+void ResultStore::Index(uint64_t rec, unsigned short int ch)
+{
+	auto& runs = index[ch];
+	if ( !runs . empty() && runs . back() . second == rec ) runs . back() . second = rec + 1;
+	else runs . emplace_back(rec, rec + 1);
+}
+
+
+void ResultStore::RebuildIndex()
+{
+	index . clear();
+	uint64_t count = GetHeader() -> count;
+	for ( uint64_t rec = 0; rec < count; rec++ )
+	{
+		Index(rec, ChannelColumn(rec / kBlockRecords)[rec % kBlockRecords]);
+	}
+}
+
+
+void ResultStore::CloseLocked()
+{
+	if ( base )
+	{
+		munmap(base, mapped);
+		base = nullptr;
+		mapped = 0;
+	}
+	if ( fd >= 0 )
+	{
+		close(fd);
+		fd = -1;
+	}
+	index . clear();
+	path . clear();
+	writable = false;
+}
@@ -0,0 +1,218 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   ScanCheckpoint.cc
+///
+///   The definition of ScanCheckpoint class.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include "global.hh"
+#include "ScanCheckpoint.hh"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+#include <nlohmann/json.hpp>
+
+
+
+///-----------------------------------------------------------------------------
+/// JSON namespace
+///-----------------------------------------------------------------------------
+using json = nlohmann::json;
+
+
+
+///-----------------------------------------------------------------------------
+/// Constructors and destructors
+///-----------------------------------------------------------------------------
+ScanCheckpoint::ScanCheckpoint() : fd(-1)
+{
+}
+
+
+ScanCheckpoint::~ScanCheckpoint()
+{
+	End(true);
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Public methods
+///-----------------------------------------------------------------------------
+///---------------------------------------------------------
+/// Start the checkpoint of a job
+///---------------------------------------------------------
+bool ScanCheckpoint::Begin(const std::string& dir, const ScanJob& job)
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	if ( fd >= 0 ) close(fd);
+
+	path = PathFor(dir, job . id);
+	fd = open(path . c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+	if ( fd < 0 )
+	{
+		std::cerr << "[kulgadd::ScanCheckpoint::Begin] Failed to open " << path << ": " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	std::string head = job . ParamsToJSONString() + "\n";
+	if ( write(fd, head . data(), head . size()) != static_cast<ssize_t>(head . size()) || fdatasync(fd) != 0 )
+	{
+		std::cerr << "[kulgadd::ScanCheckpoint::Begin] Failed to write " << path << std::endl;
+		close(fd);
+		fd = -1;
+		return false;
+	}
+	return true;
+}
+
+
+///---------------------------------------------------------
+/// A channel is finished
+///---------------------------------------------------------
+bool ScanCheckpoint::Complete(unsigned short int ch)
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	if ( fd < 0 ) return false;
+
+	// One short O_APPEND write per line, so a crash leaves whole lines
+	char line[16];
+	int n = snprintf(line, sizeof(line), "%u\n", ch);
+	return write(fd, line, n) == n && fdatasync(fd) == 0;
+}
+
+
+///---------------------------------------------------------
+/// The job is over
+///---------------------------------------------------------
+void ScanCheckpoint::End(bool keep)
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	if ( fd < 0 ) return;
+
+	close(fd);
+	fd = -1;
+	if ( !keep ) unlink(path . c_str());
+}
+
+
+///---------------------------------------------------------
+/// Read the checkpoint of a job
+///---------------------------------------------------------
+std::optional<ScanCheckpoint::Saved> ScanCheckpoint::Load(const std::string& dir, unsigned int job)
+{
+	std::ifstream in(PathFor(dir, job));
+	std::string line;
+	if ( !std::getline(in, line) ) return std::nullopt;
+
+	Saved saved;
+	std::string error;
+	if ( !saved . job . FromJSONString(line, &error) )
+	{
+		std::cerr << "[kulgadd::ScanCheckpoint::Load] Job " << job << ": " << error << std::endl;
+		return std::nullopt;
+	}
+	saved . job . id = job;
+
+	// A torn last line fails to parse and is simply not counted
+	while ( std::getline(in, line) )
+	{
+		unsigned int ch;
+		char extra;
+		if ( sscanf(line . c_str(), "%u%c", &ch, &extra) == 1 && ch <= 0xffff ) saved . done . insert(ch);
+	}
+	return saved;
+}
+
+
+///---------------------------------------------------------
+/// Jobs with a checkpoint
+///---------------------------------------------------------
+std::vector<unsigned int> ScanCheckpoint::List(const std::string& dir)
+{
+	std::vector<unsigned int> jobs;
+	std::error_code ec;
+	for ( const auto& entry : std::filesystem::directory_iterator(dir, ec) )
+	{
+		unsigned int id;
+		char ext[8];
+		if ( sscanf(entry . path() . filename() . c_str(), "job%u.%7s", &id, ext) == 2 && strcmp(ext, "ckpt") == 0 ) jobs . push_back(id);
+	}
+	std::sort(jobs . begin(), jobs . end());
+	return jobs;
+}
+
+
+bool ScanCheckpoint::Remove(const std::string& dir, unsigned int job)
+{
+	return unlink(PathFor(dir, job) . c_str()) == 0;
+}
+
+
+std::string ScanCheckpoint::PathFor(const std::string& dir, unsigned int job)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "/job%06u.ckpt", job);
+	return dir + name;
+}
+
+
+///---------------------------------------------------------
+/// Channels of the job not in the checkpoint, in scan order
+///---------------------------------------------------------
+std::vector<unsigned short int> ScanCheckpoint::Remaining(const Saved& saved)
+{
+	std::vector<unsigned short int> all = saved . job . channels;
+	if ( all . empty() )
+	{
+		for ( size_t ch = 0; ch < saved . job . ChannelCount(); ch++ ) all . push_back(ch);
+	}
+
+	std::vector<unsigned short int> left;
+	for ( unsigned short int ch : all )
+	{
+		if ( !saved . done . count(ch) ) left . push_back(ch);
+	}
+	return left;
+}
+
+
+///------------------------------------------------
+/// JSON handling: resumable jobs
+///------------------------------------------------
+std::string ScanCheckpoint::ListToJSONString(const std::string& dir)
+{
+	json list = json::array();
+	for ( unsigned int id : List(dir) )
+	{
+		auto saved = Load(dir, id);
+		if ( !saved ) continue;
+
+		json c;
+		c["job"]       = id;
+		c["done"]      = saved -> done . size();
+		c["remaining"] = Remaining(*saved) . size();
+		c["params"]    = json::parse(saved -> job . ParamsToJSONString());
+		list . push_back(c);
+	}
+
+	json j;
+	j["checkpoints"] = list;
+	return j . dump();
+}
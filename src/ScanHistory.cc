@@ -0,0 +1,239 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   ScanHistory.cc
+///
+///   The definition of ScanHistory class.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include <iostream>
+#include <nlohmann/json.hpp>
+
+#include "global.hh"
+#include "ScanHistory.hh"
+
+
+
+///-----------------------------------------------------------------------------
+/// JSON namespace
+///-----------------------------------------------------------------------------
+using json = nlohmann::json;
+
+
+
+///-----------------------------------------------------------------------------
+/// Anonymous namespace
+///-----------------------------------------------------------------------------
+namespace
+{
+	double Seconds(const struct timeval& tv)
+	{
+		return tv . tv_sec + tv . tv_usec * 1e-6;
+	}
+
+	json RecordToJSON(const ScanRecord& r)
+	{
+		json j;
+		j["job"]       = r . job;
+		j["engine"]    = ScanJob::EngineName(r . engine);
+		j["state"]     = ScanJob::StateName(r . state);
+		j["wall"]      = r . wall;
+		j["startup"]   = r . startup;
+		j["userCPU"]   = r . userCPU;
+		j["systemCPU"] = r . systemCPU;
+		j["maxRSS"]    = r . maxRSS;
+
+		// Means tell at a glance where the time goes
+		double settle = 0, sweep = 0, rampDown = 0;
+		size_t steps = 0;
+		j["channels"] = json::array();
+		for ( const auto& c : r . channels )
+		{
+			j["channels"] . push_back({ { "ch", c . ch }, { "start", c . start }, { "settle", c . settle },
+			                            { "sweep", c . sweep }, { "rampDown", c . rampDown }, { "steps", c . steps } });
+			settle   += c . settle;
+			sweep    += c . sweep;
+			rampDown += c . rampDown;
+			steps    += c . steps;
+		}
+
+		size_t n = r . channels . size();
+		if ( n > 0 )
+		{
+			j["mean"]["settle"]   = settle / n;
+			j["mean"]["sweep"]    = sweep / n;
+			j["mean"]["rampDown"] = rampDown / n;
+			if ( steps > n ) j["mean"]["step"] = sweep / (steps - n);
+		}
+		return j;
+	}
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Constructors and destructors
+///-----------------------------------------------------------------------------
+ScanHistory::ScanHistory() : active(false), current{}
+{
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Methods
+///-----------------------------------------------------------------------------
+///-----------------------------------------------
+/// A scan starts
+///-----------------------------------------------
+void ScanHistory::Begin(unsigned int job, ScanEngine engine)
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	active    = true;
+	current   = ScanRecord{};
+	current . job     = job;
+	current . engine  = engine;
+	current . state   = ScanJobState::Running;
+	current . startup = -1;
+	startTime = std::chrono::steady_clock::now();
+	open . clear();
+}
+
+
+///-----------------------------------------------
+/// Per-channel durations from the progress stream
+///-----------------------------------------------
+void ScanHistory::Apply(const ProgressEvent& ev)
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	if ( !active ) return;
+
+	switch ( ev . kind )
+	{
+		case ProgressKind::ChannelStart:
+			open[ev . ch] = OpenChannel{ current . channels . size(), 0, 0 };
+			current . channels . push_back(ChannelTiming{ ev . ch, ev . t, 0, 0, 0, 0 });
+			break;
+
+		case ProgressKind::Step:
+		{
+			auto it = open . find(ev . ch);
+			if ( it == open . end() ) break;
+			if ( it -> second . firstStep == 0 ) it -> second . firstStep = ev . t;
+			it -> second . lastStep = ev . t;
+			current . channels[it -> second . index] . steps++;
+			break;
+		}
+
+		case ProgressKind::ChannelEnd:
+		{
+			auto it = open . find(ev . ch);
+			if ( it == open . end() ) break;
+			const OpenChannel& o = it -> second;
+			ChannelTiming& c = current . channels[o . index];
+			if ( o . firstStep > 0 )
+			{
+				c . settle   = o . firstStep - c . start;
+				c . sweep    = o . lastStep - o . firstStep;
+				c . rampDown = ev . t - o . lastStep;
+			}
+			else
+			{
+				c . settle = ev . t - c . start;
+			}
+			open . erase(it);
+			break;
+		}
+
+		case ProgressKind::Compliance:
+		case ProgressKind::Breakdown:
+			break;
+	}
+}
+
+
+///-----------------------------------------------
+/// Spawn to first output of the child
+///-----------------------------------------------
+void ScanHistory::SetStartup(double ms)
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	if ( active ) current . startup = ms;
+}
+
+
+///-----------------------------------------------
+/// Resource usage, from wait4 for children
+///-----------------------------------------------
+void ScanHistory::SetUsage(const struct rusage& usage)
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	if ( !active ) return;
+	current . userCPU   = Seconds(usage . ru_utime);
+	current . systemCPU = Seconds(usage . ru_stime);
+	current . maxRSS    = usage . ru_maxrss;
+}
+
+
+///-----------------------------------------------
+/// The scan is over: file the record
+///-----------------------------------------------
+void ScanHistory::End(ScanJobState state)
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	if ( !active ) return;
+	active = false;
+
+	current . state = state;
+	current . wall  = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime) . count();
+
+	if ( gVerbose > 0 )
+	{
+		std::cout << "[kulgadd::ScanHistory::End] Job " << current . job << ": " << current . wall << " s wall, "
+		          << current . userCPU + current . systemCPU << " s CPU, " << current . channels . size() << " channels" << std::endl;
+	}
+
+	records . push_back(std::move(current));
+	while ( records . size() > kMaxRecords ) records . pop_front();
+}
+
+
+///-----------------------------------------------
+/// Record of a finished job
+///-----------------------------------------------
+std::optional<ScanRecord> ScanHistory::GetRecord(unsigned int job)
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	for ( const auto& r : records )
+	{
+		if ( r . job == job ) return r;
+	}
+	return std::nullopt;
+}
+
+
+///------------------------------------------------
+/// JSON handling: history to JSON
+///------------------------------------------------
+std::string ScanHistory::ToJSONString(std::optional<unsigned int> job)
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	json h = json::array();
+	for ( const auto& r : records )
+	{
+		if ( !job || r . job == *job ) h . push_back(RecordToJSON(r));
+	}
+
+	json j;
+	j["history"] = h;
+	return j . dump();
+}
@@ -0,0 +1,519 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   ScanJob.cc
+///
+///   The definition of ScanJob class.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <nlohmann/json.hpp>
+
+#include "global.hh"
+#include "ScanJob.hh"
+
+
+
+///-----------------------------------------------------------------------------
+/// JSON namespace
+///-----------------------------------------------------------------------------
+using json = nlohmann::json;
+
+
+
+///-----------------------------------------------------------------------------
+/// Anonymous namespace
+///-----------------------------------------------------------------------------
+namespace
+{
+	//------------------------------------------------
+	// Scan parameter schema
+	// For numbers min/max is the value range, for text the length range.
+	// A choice lists its values separated by '|', the first is the default.
+	//------------------------------------------------
+	enum class ParamType
+	{
+		Number,
+		Integer,
+		Text,
+		Choice,
+		ChannelList,
+		Ignored
+	};
+
+	struct ParamSpec
+	{
+		const char* key;
+		ParamType   type;
+		double      min;
+		double      max;
+		const char* unit;
+		const char* choices;
+	};
+
+	const ParamSpec kSchema[] =
+	{
+		{ "cmd",         ParamType::Ignored,         0,     0, "",  ""              },
+		{ "id",          ParamType::Ignored,         0,     0, "",  ""              },
+		{ "mode",        ParamType::Choice,          0,     0, "",  "normal|dryrun" },
+		{ "engine",      ParamType::Choice,          0,     0, "",  "script|native|worker" },
+		{ "priority",    ParamType::Integer,     -1000,  1000, "",  ""              },
+		{ "sensorname",  ParamType::Text,            1,    64, "",  ""              },
+		{ "basepath",    ParamType::Text,            1,  4096, "",  ""              },
+		{ "Vstart",      ParamType::Number,      -1100,  1100, "V", ""              },
+		{ "Vend",        ParamType::Number,      -1100,  1100, "V", ""              },
+		{ "Vstep",       ParamType::Number,      0.001,   100, "V", ""              },
+		{ "Icompliance", ParamType::Number,      1e-12,   0.1, "A", ""              },
+		{ "channels",    ParamType::ChannelList,     0,   255, "",  ""              },
+		{ "stop",        ParamType::Choice,          0,     0, "",  "none|compliance|slope|any" },
+		{ "slopeLimit",  ParamType::Number,      1e-15,     1, "A/V", ""            },
+		{ "slopePoints", ParamType::Integer,         1,   100, "",  ""              },
+		{ "stepping",    ParamType::Choice,          0,     0, "",  "fixed|adaptive" },
+		{ "VstepMin",    ParamType::Number,      0.001,   100, "V", ""              },
+		{ "VstepMax",    ParamType::Number,      0.001,   100, "V", ""              },
+		{ "maxPoints",   ParamType::Integer,         2, 10000, "",  ""              },
+	};
+
+	// Upper bound of voltage points per channel
+	constexpr double kMaxSweepPoints = 10000;
+
+	const ParamSpec* FindSpec(const std::string& key)
+	{
+		for ( const auto& spec : kSchema )
+		{
+			if ( key == spec . key ) return &spec;
+		}
+		return nullptr;
+	}
+
+	const char* TypeName(ParamType t)
+	{
+		switch ( t )
+		{
+			case ParamType::Number:      return "number";
+			case ParamType::Integer:     return "integer";
+			case ParamType::Text:        return "string";
+			case ParamType::Choice:      return "choice";
+			case ParamType::ChannelList: return "channels";
+			case ParamType::Ignored:     return "ignored";
+		}
+		return "unknown";
+	}
+
+	// Position of a value in a '|' separated choice list, -1 if absent
+	int ChoiceIndex(const char* choices, const std::string& value)
+	{
+		std::string list = choices;
+		size_t begin = 0;
+		for ( int i = 0; begin <= list . size(); i++ )
+		{
+			size_t end = list . find('|', begin);
+			if ( end == std::string::npos ) end = list . size();
+			if ( list . compare(begin, end - begin, value) == 0 ) return i;
+			begin = end + 1;
+		}
+		return -1;
+	}
+
+	// Plain decimal text of a parameter value
+	std::string FormatNumber(double v)
+	{
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%.15g", v);
+		return buf;
+	}
+
+	// Scan parameters, the same in a job listing and in a checkpoint
+	void ParamsToJSON(const ScanJob& job, json& j)
+	{
+		j["priority"]    = job . priority;
+		j["mode"]        = job . dryrun ? "dryrun" : "normal";
+		j["engine"]      = ScanJob::EngineName(job . engine);
+		j["sensorname"]  = job . sensorname;
+		j["Vstart"]      = job . Vstart;
+		j["Vend"]        = job . Vend;
+		j["Vstep"]       = job . Vstep;
+		j["Icompliance"] = job . Icompliance;
+		j["channels"]    = job . channels;
+		j["stop"]        = ScanJob::StopRuleName(job . stopRule);
+		if ( job . stopRule != StopRule::None )
+		{
+			j["slopeLimit"]  = job . slopeLimit;
+			j["slopePoints"] = job . slopePoints;
+		}
+		j["stepping"]    = ScanJob::SteppingName(job . stepping);
+		if ( job . stepping == Stepping::Adaptive )
+		{
+			j["VstepMin"]  = job . VstepMin;
+			j["VstepMax"]  = job . VstepMax;
+			j["maxPoints"] = job . maxPoints;
+		}
+		if ( !job . basepath . empty() ) j["basepath"] = job . basepath;
+	}
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Constructors and destructors
+///-----------------------------------------------------------------------------
+///-----------------------------------------------
+/// Default: same sweep as the former hard-coded normal mode
+///-----------------------------------------------
+ScanJob::ScanJob()
+	: id(0), priority(0), state(ScanJobState::Queued), cancelRequested(false), resumes(0),
+	  sensorname("w5a"), Vstart(0), Vend(-50), Vstep(1), Icompliance(1e-5), dryrun(false),
+	  engine(ScanEngine::Script), stopRule(StopRule::None), slopeLimit(1e-9), slopePoints(3),
+	  stepping(Stepping::Fixed), VstepMin(0.1), VstepMax(10), maxPoints(200)
+{
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Methods
+///-----------------------------------------------------------------------------
+///-----------------------------------------------
+/// Argument vector for the scan script
+///-----------------------------------------------
+std::vector<std::string> ScanJob::ToArgv(const std::string& script) const
+{
+	std::vector<std::string> argv = { "python3", script };
+
+	if ( dryrun )
+	{
+		argv . push_back("--dryrun");
+	}
+	else
+	{
+		argv . insert(argv . end(),
+		{
+			"--Vstart",      FormatNumber(Vstart),
+			"--Vend",        FormatNumber(Vend),
+			"--Vstep",       FormatNumber(Vstep),
+			"--sensorname",  sensorname,
+			"--Icompliance", FormatNumber(Icompliance)
+		});
+	}
+
+	if ( !basepath . empty() )
+	{
+		argv . push_back("--basepath");
+		argv . push_back(basepath);
+	}
+
+	// No channels means the whole matrix, whose size only the daemon knows
+	if ( channels . empty() )
+	{
+		argv . push_back("--nchannels");
+		argv . push_back(std::to_string(ChannelCount()));
+	}
+	for ( unsigned short int ch : channels ) argv . push_back(std::to_string(ch));
+
+	return argv;
+}
+
+
+///------------------------------------------------
+/// JSON handling: job to JSON
+///------------------------------------------------
+std::string ScanJob::ToJSONString() const
+{
+	json j;
+	j["id"]          = id;
+	j["state"]       = StateName(state);
+	ParamsToJSON(*this, j);
+	if ( exitStatus ) j["exit"] = exitStatus . value();
+	if ( resumes ) j["resumes"] = resumes;
+
+	return j . dump();
+}
+
+
+///------------------------------------------------
+/// JSON handling: scan parameters to JSON
+///------------------------------------------------
+std::string ScanJob::ParamsToJSONString() const
+{
+	json j;
+	ParamsToJSON(*this, j);
+	return j . dump();
+}
+
+
+///------------------------------------------------
+/// JSON handling: scan command to job
+/// Keys that are absent keep their default value.
+/// Unknown keys, wrong types and out-of-range values are rejected.
+///------------------------------------------------
+bool ScanJob::FromJSONString(const std::string& jsonStr, std::string* error)
+{
+	auto fail = [&](const std::string& why)
+	{
+		if ( error ) *error = why;
+		if ( gVerbose > 0 ) std::cerr << "[kulgadd::ScanJob::FromJSONString] " << why << std::endl;
+		return false;
+	};
+
+	json j;
+	try
+	{
+		j = json::parse(jsonStr);
+	}
+	catch ( const std::exception& e )
+	{
+		return fail(e . what());
+	}
+	if ( !j . is_object() ) return fail("scan request must be an object");
+
+	for ( const auto& [key, val] : j . items() )
+	{
+		const ParamSpec* spec = FindSpec(key);
+		if ( !spec ) return fail("unknown parameter '" + key + "'");
+
+		switch ( spec -> type )
+		{
+			case ParamType::Ignored:
+				break;
+
+			case ParamType::Choice:
+			{
+				int idx = val . is_string() ? ChoiceIndex(spec -> choices, val . get<std::string>()) : -1;
+				if ( idx < 0 ) return fail(key + " must be one of " + spec -> choices);
+				if      ( key == "mode"     ) dryrun = (idx == 1);
+				else if ( key == "engine"   ) engine = static_cast<ScanEngine>(idx);
+				else if ( key == "stop"     ) stopRule = static_cast<StopRule>(idx);
+				else if ( key == "stepping" ) stepping = static_cast<Stepping>(idx);
+				break;
+			}
+
+			case ParamType::Integer:
+				if ( !val . is_number_integer() ) return fail(key + " must be an integer");
+				if ( val . get<double>() < spec -> min || val . get<double>() > spec -> max ) return fail(key + " out of range");
+				if      ( key == "priority"    ) priority    = val . get<int>();
+				else if ( key == "slopePoints" ) slopePoints = val . get<int>();
+				else if ( key == "maxPoints"   ) maxPoints   = val . get<int>();
+				break;
+
+			case ParamType::Number:
+			{
+				if ( !val . is_number() ) return fail(key + " must be a number");
+				double v = val . get<double>();
+				if ( !(v >= spec -> min && v <= spec -> max) ) return fail(key + " out of range");
+				if      ( key == "Vstart"      ) Vstart      = v;
+				else if ( key == "Vend"        ) Vend        = v;
+				else if ( key == "Vstep"       ) Vstep       = v;
+				else if ( key == "Icompliance" ) Icompliance = v;
+				else if ( key == "slopeLimit"  ) slopeLimit  = v;
+				else if ( key == "VstepMin"    ) VstepMin    = v;
+				else if ( key == "VstepMax"    ) VstepMax    = v;
+				break;
+			}
+
+			case ParamType::Text:
+			{
+				if ( !val . is_string() ) return fail(key + " must be a string");
+				std::string v = val . get<std::string>();
+				if ( v . size() < spec -> min || v . size() > spec -> max ) return fail(key + " has a bad length");
+				if ( v[0] == '-' ) return fail(key + " must not start with '-'");
+				if ( v . find('\0') != std::string::npos ) return fail(key + " contains NUL");
+				if      ( key == "sensorname" ) sensorname = v;
+				else if ( key == "basepath"   ) basepath   = v;
+				break;
+			}
+
+			case ParamType::ChannelList:
+				if ( !val . is_array() ) return fail(key + " must be an array");
+				channels . clear();
+				{
+					// One entry per channel: checkpoints and the pad map count on it
+					std::vector<bool> seen(spec -> max + 1, false);
+					for ( const auto& ch : val )
+					{
+						if ( !ch . is_number_integer() ) return fail("channel must be an integer");
+						long long c = ch . get<long long>();
+						if ( c < spec -> min || c > spec -> max ) return fail("channel " + std::to_string(c) + " out of range");
+						if ( seen[c] ) return fail("channel " + std::to_string(c) + " listed twice");
+						seen[c] = true;
+						channels . push_back(c);
+					}
+				}
+				break;
+		}
+	}
+
+	//--------------------------------------
+	// Cross-field checks
+	//--------------------------------------
+	// The sensor name becomes part of result file names
+	for ( char c : sensorname )
+	{
+		if ( !isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '-' && c != '.' ) return fail("sensorname may only contain [A-Za-z0-9_.-]");
+	}
+
+	// Adaptive sweeps are bounded by maxPoints instead
+	if ( stepping == Stepping::Fixed && std::abs(Vend - Vstart) / Vstep > kMaxSweepPoints ) return fail("too many voltage points per channel");
+
+	// Only the daemon's own sweep sees every point in time to stop or adapt
+	if ( stopRule != StopRule::None && engine != ScanEngine::Native ) return fail("stop rules need the native engine");
+	if ( stepping != Stepping::Fixed && engine != ScanEngine::Native ) return fail("adaptive stepping needs the native engine");
+	if ( stepping == Stepping::Adaptive && !(VstepMin <= Vstep && Vstep <= VstepMax) ) return fail("Vstep must lie within VstepMin and VstepMax");
+	if ( stepping == Stepping::Adaptive && maxPoints < std::ceil(std::abs(Vend - Vstart) / VstepMax - 1e-9) + 1 ) return fail("maxPoints too small to reach Vend in steps of VstepMax");
+
+	return true;
+}
+
+
+///------------------------------------------------
+/// JSON handling: schema to JSON, for clients building scan forms
+///------------------------------------------------
+std::string ScanJob::SchemaToJSONString()
+{
+	ScanJob defaults;
+	json d = json::parse(defaults . ToJSONString());
+
+	json j;
+	j["schema"] = json::array();
+	for ( const auto& spec : kSchema )
+	{
+		if ( spec . type == ParamType::Ignored ) continue;
+
+		json p;
+		p["key"]  = spec . key;
+		p["type"] = TypeName(spec . type);
+		if ( spec . type == ParamType::Choice )
+		{
+			p["choices"] = spec . choices;
+		}
+		else
+		{
+			p["min"] = spec . min;
+			p["max"] = spec . max;
+		}
+		if ( *spec . unit        ) p["unit"]    = spec . unit;
+		if ( d . contains(spec . key) ) p["default"] = d[spec . key];
+		j["schema"] . push_back(p);
+	}
+
+	return j . dump();
+}
+
+
+///------------------------------------------------
+/// Finished one way or another?
+///------------------------------------------------
+bool ScanJob::IsFinished() const
+{
+	return state == ScanJobState::Done || state == ScanJobState::Failed || state == ScanJobState::Cancelled;
+}
+
+
+///------------------------------------------------
+/// Sweep points
+///------------------------------------------------
+std::vector<double> ScanJob::Voltages() const
+{
+	std::vector<double> steps;
+	double dir = Vend >= Vstart ? 1 : -1;
+	size_t n = static_cast<size_t>(std::floor(std::abs(Vend - Vstart) / Vstep + 1e-9));
+	for ( size_t i = 0; i <= n; i++ ) steps . push_back(Vstart + dir * Vstep * i);
+	if ( std::abs(steps . back() - Vend) > 1e-9 ) steps . push_back(Vend);
+	return steps;
+}
+
+
+///------------------------------------------------
+/// Point budget of one channel
+///------------------------------------------------
+size_t ScanJob::PointCount() const
+{
+	if ( stepping == Stepping::Adaptive ) return maxPoints;
+	return Voltages() . size();
+}
+
+
+///------------------------------------------------
+/// Channel count, all pins of the grid when none are listed
+///------------------------------------------------
+size_t ScanJob::ChannelCount() const
+{
+	if ( !channels . empty() ) return channels . size();
+	return gGrid ? gGrid -> GetTotal() : 256;
+}
+
+
+///------------------------------------------------
+/// State name
+///------------------------------------------------
+const char* ScanJob::StateName(ScanJobState s)
+{
+	switch ( s )
+	{
+		case ScanJobState::Queued:    return "queued";
+		case ScanJobState::Running:   return "running";
+		case ScanJobState::Done:      return "done";
+		case ScanJobState::Failed:    return "failed";
+		case ScanJobState::Cancelled: return "cancelled";
+	}
+
+	return "unknown";
+}
+
+
+///------------------------------------------------
+/// Engine name
+///------------------------------------------------
+const char* ScanJob::EngineName(ScanEngine e)
+{
+	switch ( e )
+	{
+		case ScanEngine::Script: return "script";
+		case ScanEngine::Native: return "native";
+		case ScanEngine::Worker: return "worker";
+	}
+
+	return "unknown";
+}
+
+
+///------------------------------------------------
+/// Stop rule name
+///------------------------------------------------
+const char* ScanJob::StopRuleName(StopRule r)
+{
+	switch ( r )
+	{
+		case StopRule::None:       return "none";
+		case StopRule::Compliance: return "compliance";
+		case StopRule::Slope:      return "slope";
+		case StopRule::Any:        return "any";
+	}
+
+	return "unknown";
+}
+
+
+///------------------------------------------------
+/// Stepping name
+///------------------------------------------------
+const char* ScanJob::SteppingName(Stepping s)
+{
+	switch ( s )
+	{
+		case Stepping::Fixed:    return "fixed";
+		case Stepping::Adaptive: return "adaptive";
+	}
+
+	return "unknown";
+}
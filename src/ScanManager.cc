@@ -15,6 +15,11 @@
 ///-----------------------------------------------------------------------------
 /// Headers
 ///-----------------------------------------------------------------------------
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <filesystem>
+#include <cstdio>
 #include <nlohmann/json.hpp>
 
 #include "ScanManager.hh"
@@ -29,16 +34,75 @@ using json = nlohmann::json;
 
 
 
+///-----------------------------------------------------------------------------
+/// Anonymous namespace
+///-----------------------------------------------------------------------------
+namespace
+{
+	// Number of finished jobs kept for queries
+	constexpr size_t kMaxFinishedJobs = 64;
+
+	// Fallback reap interval when pidfd is not available
+	constexpr int kReapPollMs = 100;
+
+	// Where scan children find the progress channel
+	constexpr int kProgressFd = 3;
+
+	int PidfdOpen(pid_t pid)
+	{
+#ifdef SYS_pidfd_open
+		return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#else
+		errno = ENOSYS;
+		return -1;
+#endif
+	}
+
+	void ArmTimer(int fd, int ms)
+	{
+		itimerspec its = {};
+		its . it_value . tv_sec  = ms / 1000;
+		its . it_value . tv_nsec = (ms % 1000) * 1000000L;
+		timerfd_settime(fd, 0, &its, nullptr);
+	}
+}
+
+
+
 ///----------------------------------------------------------------------------
 /// Constructor / Destructor
 ///----------------------------------------------------------------------------
 ScanManager::ScanManager()
-	: pid_(-1), running(false), stdout_fd(-1), stderr_fd(-1)
+	: script("/sw/kulgadd/dev/source/scripts/iv_all.py"),
+	  pid_(-1), running(false), stdout_fd(-1), stderr_fd(-1), progress_fd(-1), datadir("/var/lib/kulgadd"),
+	  reactor_quit(false), epoll_fd(-1), wake_fd(-1), timer_fd(-1), pid_fd(-1), first_output(false), native(false), warm(false),
+	  next_job_id(1), current_job(0), scheduler_quit(false)
 {
 	if ( gVerbose > 1 )
 	{
 		std::cout << "[kulgadd::ScanManager] Contructed." << std::endl;
 	}
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	wake_fd  = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	if ( epoll_fd < 0 || wake_fd < 0 || timer_fd < 0 )
+	{
+		throw std::runtime_error("[kulgadd::ScanManager] Failed to create reactor fds");
+	}
+
+	epoll_event ev = {};
+	ev . events = EPOLLIN;
+	ev . data . fd = wake_fd;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+	ev . data . fd = timer_fd;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev);
+
+	sweep . SetListener([this](const ProgressEvent& ev) { HandleEvent(ev); });
+	worker . SetListener([this](const ProgressEvent& ev) { HandleEvent(ev); });
+
+	reactor_thread = std::thread(&ScanManager::ReactorLoop, this);
+	scheduler_thread = std::thread(&ScanManager::SchedulerLoop, this);
 }
 
 
@@ -49,6 +113,12 @@ ScanManager::~ScanManager()
 		std::cout << "[kulgadd::ScanManager] Detructed." << std::endl;
 	}
 
+	{
+		std::lock_guard<std::mutex> lk(queue_mutex);
+		scheduler_quit = true;
+	}
+	queue_cv . notify_all();
+
 	try
 	{
 		Stop();
@@ -57,7 +127,17 @@ ScanManager::~ScanManager()
 	{
 	}
 
-	CleanupReaders();
+	if ( scheduler_thread . joinable() ) scheduler_thread . join();
+
+	reactor_quit = true;
+	uint64_t one = 1;
+	if ( write(wake_fd, &one, sizeof(one)) < 0 ) {}
+	if ( reactor_thread . joinable() ) reactor_thread . join();
+
+	CloseChildFds();
+	close(timer_fd);
+	close(wake_fd);
+	close(epoll_fd);
 }
 
 
@@ -66,32 +146,106 @@ ScanManager::~ScanManager()
 /// Public methods
 ///----------------------------------------------------------------------------
 ///---------------------------------------------------------
-/// Set command
+/// Set scan script path
+///---------------------------------------------------------
+void ScanManager::SetScript(const std::string& path)
+{
+	if ( gVerbose > 1 )
+	{
+		std::cout << "[kulgadd::ScanManager::SetScript] Set script to: " << path << std::endl;
+	}
+
+	script = path;
+
+	// The worker lives next to the scan script
+	std::string dir = std::filesystem::path(path) . parent_path();
+	worker . SetScript((dir . empty() ? std::string(".") : dir) + "/scan_worker.py");
+}
+
+
+///---------------------------------------------------------
+/// Set source-meters for native sweeps; see SweepPool
+///---------------------------------------------------------
+bool ScanManager::SetSMU(const std::string& spec)
+{
+	if ( gVerbose > 1 )
+	{
+		std::cout << "[kulgadd::ScanManager::SetSMU] Set SMU to: " << spec << std::endl;
+	}
+
+	return sweep . SetSMU(spec);
+}
+
+
+///---------------------------------------------------------
+/// Set directory of the result stores
+///---------------------------------------------------------
+void ScanManager::SetDataDir(const std::string& dir)
+{
+	if ( gVerbose > 1 )
+	{
+		std::cout << "[kulgadd::ScanManager::SetDataDir] Set data directory to: " << dir << std::endl;
+	}
+
+	datadir = dir;
+
+	// Job ids name the store and checkpoint files, so carry on after the last one on disk
+	std::error_code ec;
+	unsigned int last = 0;
+	for ( const auto& entry : std::filesystem::directory_iterator(datadir, ec) )
+	{
+		unsigned int id;
+		if ( sscanf(entry . path() . filename() . c_str(), "job%u.", &id) == 1 ) last = std::max(last, id);
+	}
+
+	if ( gGrid ) pads . SetGeometry(gGrid -> GetRows(), gGrid -> GetCols());
+	pads . Load(datadir + "/heatmap.json");
+
+	std::lock_guard<std::mutex> lk(queue_mutex);
+	next_job_id = std::max(next_job_id, last + 1);
+}
+
+
+///---------------------------------------------------------
+/// Keep a warm worker for "worker" jobs, recycled after
+/// the given number of jobs (0: never)
 ///---------------------------------------------------------
-void ScanManager::SetCMD(const std::string& cmd)
+void ScanManager::StartWorker(unsigned int recycle)
 {
 	if ( gVerbose > 1 )
 	{
-		std::cout << "[kulgadd::ScanManager::SetCMD] Set command to: " << cmd << std::endl;
+		std::cout << "[kulgadd::ScanManager::StartWorker] Recycle after " << recycle << " jobs" << std::endl;
 	}
 
-    command = cmd;
+	worker . SetRecycle(recycle);
+	worker . Start();
 }
 
 
 ///---------------------------------------------------------
 /// Start process
+/// Called by the scheduler thread only; queue jobs with Enqueue.
 ///---------------------------------------------------------
-bool ScanManager::Start(unsigned short int mode)
+bool ScanManager::Start(const ScanJob& job)
 {
 	if ( gVerbose > 1 )
 	{
-		std::cout << "[kulgadd::ScanManager::Start] Start scanning" << std::endl;
+		std::cout << "[kulgadd::ScanManager::Start] Start scanning job " << job . id << std::endl;
 	}
 
-	if      ( mode == 0 ) SetCMD("python3 /sw/kulgadd/dev/source/scripts/iv_all.py --Vstart 0 --Vend -50 --Vstep 1 --sensorname w5a --Icompliance 1e-5");
-	else if ( mode == 1 ) SetCMD("python3 /sw/kulgadd/dev/source/scripts/iv_all.py --dryrun");
+	argv_ = job . ToArgv(script);
+
+	if ( gVerbose > 0 )
+	{
+		std::cout << "[kulgadd::ScanManager::Start] Command:";
+		for ( const auto& arg : argv_ ) std::cout << " " << arg;
+		std::cout << std::endl;
+	}
 
+	{
+		std::lock_guard<std::mutex> lk(queue_mutex);
+		if ( scheduler_quit ) return false;
+	}
 
 	if ( running . load() )
 	{
@@ -103,114 +257,288 @@ bool ScanManager::Start(unsigned short int mode)
 		return false;
 	}
 
-	int outpipe[2];
-	int errpipe[2];
-	if ( pipe(outpipe) == -1 ) return false;
-	if ( pipe(errpipe) == -1 )
+	// stdout, stderr and the progress channel.
+	// Read ends are non-blocking for the reactor; O_CLOEXEC keeps them out of
+	// the child, whose write ends are dup2'ed by Spawn (which clears the flag).
+	int pipes[3][2];
+	for ( int i = 0; i < 3; i++ )
 	{
-		close(outpipe[0]);
-		close(outpipe[1]);
-		return false;
+		if ( pipe2(pipes[i], O_CLOEXEC) == -1 )
+		{
+			for ( int k = 0; k < i; k++ )
+			{
+				close(pipes[k][0]);
+				close(pipes[k][1]);
+			}
+			return false;
+		}
 	}
 
-	pid_t p = fork();
-	if ( p < 0 )
+	// The reactor only looks at these once the fds below are registered
+	spawn_time = std::chrono::steady_clock::now();
+	first_output = false;
+
+	pid_t p = Spawn(argv_,
+	                { { pipes[0][1], STDOUT_FILENO }, { pipes[1][1], STDERR_FILENO }, { pipes[2][1], kProgressFd } },
+	                { "KULGADD_PROGRESS_FD=" + std::to_string(kProgressFd) });
+
+	for ( int i = 0; i < 3; i++ )
 	{
-		close(outpipe[0]);
-		close(outpipe[1]);
-		close(errpipe[0]);
-		close(errpipe[1]);
-		return false;
+		close(pipes[i][1]);
+		if ( p < 0 ) close(pipes[i][0]);
+		else         fcntl(pipes[i][0], F_SETFL, O_NONBLOCK);
 	}
+	if ( p < 0 ) return false;
 
-	if ( p == 0 )
 	{
-		// Child
-		dup2(outpipe[1], STDOUT_FILENO);
-		dup2(errpipe[1], STDERR_FILENO);
-
-		close(outpipe[0]);
-		close(outpipe[1]);
-		close(errpipe[0]);
-		close(errpipe[1]);
+		std::lock_guard<std::mutex> lk(stdout_mutex);
+		stdout_buf . clear();
+	}
+	{
+		std::lock_guard<std::mutex> lk(stderr_mutex);
+		stderr_buf . clear();
+	}
 
-		setpgid(0, 0);
+	//--------------------------------------
+	// Hand the child over to the reactor
+	//--------------------------------------
+	std::lock_guard<std::mutex> lk(status_mutex);
+	exit_status . reset();
+	pid_ = p;
+	stdout_fd = pipes[0][0];
+	stderr_fd = pipes[1][0];
+	progress_fd = pipes[2][0];
+	pid_fd = PidfdOpen(p);
+	if ( pid_fd < 0 && gVerbose > 0 )
+	{
+		std::cerr << "[kulgadd::ScanManager::Start] pidfd_open: " << strerror(errno) << ", falling back to polling" << std::endl;
+	}
+	running . store(true);
 
-		execl("/bin/bash", "bash", "-c", command . c_str(), (char*) nullptr);
-		_exit(127); // exec failed
+	epoll_event ev = {};
+	ev . events = EPOLLIN;
+	for ( int fd : { stdout_fd, stderr_fd, progress_fd, pid_fd } )
+	{
+		if ( fd < 0 ) continue;
+		ev . data . fd = fd;
+		epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
 	}
 
-	// Parent
-	pid_ = p;
-	close(outpipe[1]);
-	close(errpipe[1]);
+	// Get the reactor out of its fallback poll interval
+	uint64_t one = 1;
+	if ( write(wake_fd, &one, sizeof(one)) < 0 ) {}
 
-	stdout_fd = outpipe[0];
-	stderr_fd = errpipe[0];
+	return true;
+}
 
-	running . store(true);
 
-	stdout_thread = std::thread(&ScanManager::ReaderThread, this,
-		                        stdout_fd, std::ref(stdout_buf), std::ref(stdout_mutex));
-	stderr_thread = std::thread(&ScanManager::ReaderThread, this,
-		                        stderr_fd, std::ref(stderr_buf), std::ref(stderr_mutex));
+///---------------------------------------------------------
+/// Launch argv directly, without a shell, in its own process group.
+/// fds: {parent fd, child fd} pairs dup2'ed in the child.
+/// extraEnv: "KEY=value" entries added to the sanitized environment.
+/// posix_spawn uses CLONE_VM|CLONE_VFORK, so the daemon's page tables
+/// are not copied.
+///---------------------------------------------------------
+pid_t ScanManager::Spawn(const std::vector<std::string>& argv, const std::vector<std::pair<int, int>>& fds,
+                         const std::vector<std::string>& extraEnv)
+{
+	if ( argv . empty() ) return -1;
 
-	return true;
+	std::vector<char*> cargv;
+	for ( const auto& arg : argv ) cargv . push_back(const_cast<char*>(arg . c_str()));
+	cargv . push_back(nullptr);
+
+	std::vector<std::string> env = SanitizedEnvironment();
+	env . insert(env . end(), extraEnv . begin(), extraEnv . end());
+	std::vector<char*> cenv;
+	for ( const auto& e : env ) cenv . push_back(const_cast<char*>(e . c_str()));
+	cenv . push_back(nullptr);
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	for ( const auto& [from, to] : fds ) posix_spawn_file_actions_adddup2(&actions, from, to);
+
+	// Own process group so Stop can signal the whole tree; default signal
+	// dispositions and an empty mask whatever the daemon set up.
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+	sigset_t none, defaults;
+	sigemptyset(&none);
+	sigemptyset(&defaults);
+	for ( int sig : { SIGINT, SIGTERM, SIGPIPE, SIGCHLD, SIGHUP } ) sigaddset(&defaults, sig);
+	posix_spawnattr_setsigmask(&attr, &none);
+	posix_spawnattr_setsigdefault(&attr, &defaults);
+	posix_spawnattr_setpgroup(&attr, 0);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+	pid_t p = -1;
+	int err = posix_spawnp(&p, cargv[0], &actions, &attr, cargv . data(), cenv . data());
+
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+
+	if ( err != 0 )
+	{
+		std::cerr << "[kulgadd::ScanManager::Spawn] " << argv[0] << ": " << strerror(err) << std::endl;
+		return -1;
+	}
+	return p;
 }
 
 
 ///---------------------------------------------------------
-/// Get running status
+/// Environment for scan children: a short whitelist of the
+/// daemon's own plus unbuffered Python output.
 ///---------------------------------------------------------
-bool ScanManager::IsRunning()
+std::vector<std::string> ScanManager::SanitizedEnvironment()
 {
-	if ( !running . load() || pid_ <= 0 ) return false;
+	static const char* keep[] = { "HOME", "USER", "LANG", "LC_ALL", "TZ", "PYTHONPATH", "VIRTUAL_ENV" };
 
-	int status = 0;
-	pid_t r = waitpid(pid_, &status, WNOHANG);
-	if ( r == 0 )
+	std::vector<std::string> env;
+	const char* path = getenv("PATH");
+	env . push_back(std::string("PATH=") + (path ? path : "/usr/local/bin:/usr/bin:/bin"));
+	for ( const char* key : keep )
 	{
-		return true;
+		const char* val = getenv(key);
+		if ( val ) env . push_back(std::string(key) + "=" + val);
 	}
-	else if ( r == pid_ )
+	env . push_back("PYTHONUNBUFFERED=1");
+	return env;
+}
+
+
+///---------------------------------------------------------
+/// Benchmark: spawn-to-first-output latency, stdout or stderr.
+/// Compares direct spawn with the former fork + bash -c launch.
+///---------------------------------------------------------
+void ScanManager::BenchmarkSpawn(const std::vector<std::string>& argv, int runs, std::ostream& os)
+{
+	// Single-quoted command line for the shell variant
+	std::string joined;
+	for ( const auto& arg : argv )
 	{
-		std::lock_guard<std::mutex> lk(status_mutex);
-		exit_status = status;
-		running . store(false);
-		CleanupReaders();
-		return false;
+		std::string quoted = "'";
+		for ( char c : arg ) quoted += (c == '\'' ? std::string("'\\''") : std::string(1, c));
+		joined += (joined . empty() ? "" : " ") + quoted + "'";
 	}
-	else
+
+	auto measure = [&](bool viaShell) -> double
 	{
-		running . store(false);
-		CleanupReaders();
-		return false;
+		int out[2];
+		if ( pipe2(out, O_CLOEXEC) == -1 ) return -1;
+
+		auto t0 = std::chrono::steady_clock::now();
+		pid_t p;
+		if ( viaShell )
+		{
+			p = fork();
+			if ( p == 0 )
+			{
+				dup2(out[1], STDOUT_FILENO);
+				dup2(out[1], STDERR_FILENO);
+				execl("/bin/bash", "bash", "-c", joined . c_str(), (char*) nullptr);
+				_exit(127);
+			}
+		}
+		else
+		{
+			p = Spawn(argv, { { out[1], STDOUT_FILENO }, { out[1], STDERR_FILENO } });
+		}
+		close(out[1]);
+		if ( p < 0 )
+		{
+			close(out[0]);
+			return -1;
+		}
+
+		char c;
+		ssize_t n = read(out[0], &c, 1);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0) . count();
+
+		// Let it finish quietly
+		char sink[4096];
+		while ( read(out[0], sink, sizeof(sink)) > 0 );
+		close(out[0]);
+		waitpid(p, nullptr, 0);
+		return n == 1 ? ms : -1;
+	};
+
+	os << "[kulgadd::ScanManager::BenchmarkSpawn] " << joined << std::endl;
+	for ( bool viaShell : { false, true } )
+	{
+		std::vector<double> t;
+		for ( int i = 0; i < runs; i++ )
+		{
+			double ms = measure(viaShell);
+			if ( ms >= 0 ) t . push_back(ms);
+		}
+		if ( t . empty() )
+		{
+			os << "  " << (viaShell ? "fork+bash  " : "posix_spawn") << ": no output" << std::endl;
+			continue;
+		}
+
+		std::sort(t . begin(), t . end());
+		double sum = 0;
+		for ( double v : t ) sum += v;
+		os << "  " << (viaShell ? "fork+bash  " : "posix_spawn")
+		   << ": runs "   << t . size()
+		   << ", min "    << t . front()                  << " ms"
+		   << ", median " << t[t . size() / 2]            << " ms"
+		   << ", mean "   << sum / t . size()             << " ms"
+		   << ", max "    << t . back()                   << " ms" << std::endl;
 	}
 }
 
 
 ///---------------------------------------------------------
-/// Kill the process
+/// Get running status
+/// The reactor thread is the only one reaping the child.
+///---------------------------------------------------------
+bool ScanManager::IsRunning()
+{
+	return running . load();
+}
+
+
+///---------------------------------------------------------
+/// Kill the process and wait for it
 ///---------------------------------------------------------
 void ScanManager::Stop(int timeout_ms)
 {
-	if ( pid_ <= 0 ) return;
-	if ( !running . load() ) return;
-	
-	kill(-pid_, SIGTERM);
+	if ( !Terminate(timeout_ms) ) return;
+
+	std::unique_lock<std::mutex> lk(status_mutex);
+	exit_cv . wait(lk, [&] { return !running . load() || pid_ <= 0; });
+}
+
 
-	auto start = std::chrono::steady_clock::now();
-	while ( IsRunning() )
+///---------------------------------------------------------
+/// Ask the process to end without waiting.
+/// SIGTERM now, SIGKILL from the reactor when the timer fires.
+///---------------------------------------------------------
+bool ScanManager::Terminate(int timeout_ms)
+{
+	if ( !running . load() ) return false;
+
+	// Native sweeps ramp down and return by themselves
+	if ( native . load() )
 	{
-		auto now = std::chrono::steady_clock::now();
-		if ( std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count() > timeout_ms )
-		{
-			kill(-pid_, SIGKILL);
-			break;
-		}
-		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		sweep . Abort();
+		return false;
+	}
+	if ( warm . load() )
+	{
+		worker . Abort();
+		return false;
 	}
-	IsRunning();
+
+	std::lock_guard<std::mutex> lk(status_mutex);
+	if ( pid_ <= 0 || !running . load() ) return false;
+
+	kill(-pid_, SIGTERM);
+	ArmTimer(timer_fd, timeout_ms > 0 ? timeout_ms : 1);
+	return true;
 }
 
 
@@ -237,26 +565,228 @@ std::string ScanManager::ReadStdErr()
 
 void ScanManager::Wait()
 {
-	if ( pid_ <= 0 ) return;
-	int status = 0;
-	if ( waitpid(pid_, &status, 0) == pid_ )
+	std::unique_lock<std::mutex> lk(status_mutex);
+	exit_cv . wait(lk, [&] { return !running . load() || pid_ <= 0; });
+}
+
+
+///---------------------------------------------------------
+/// Queue a job, returns its id
+///---------------------------------------------------------
+unsigned int ScanManager::Enqueue(ScanJob job)
+{
+	std::unique_lock<std::mutex> lk(queue_mutex);
+	job . id = next_job_id++;
+	job . state = ScanJobState::Queued;
+	job . cancelRequested = false;
+	job . exitStatus . reset();
+	jobs . push_back(job);
+
+	if ( gVerbose > 0 )
 	{
-		std::lock_guard<std::mutex> lk(status_mutex);
-		exit_status = status;
-		running . store(false);
-		CleanupReaders();
+		std::cout << "[kulgadd::ScanManager::Enqueue] Job " << job . id << " queued with priority " << job . priority << std::endl;
+	}
+
+	// Still locked, so clients never see the job running before queued
+	NotifyJob(job);
+	lk . unlock();
+	queue_cv . notify_all();
+	return job . id;
+}
+
+
+///---------------------------------------------------------
+/// Queue the channels an interrupted job did not finish,
+/// with the same parameters
+///---------------------------------------------------------
+unsigned int ScanManager::Resume(unsigned int id, std::string* error)
+{
+	auto saved = ScanCheckpoint::Load(datadir, id);
+	if ( !saved )
+	{
+		if ( error ) *error = "no checkpoint for job " + std::to_string(id);
+		return 0;
+	}
+
+	{
+		std::lock_guard<std::mutex> lk(queue_mutex);
+		for ( const auto& job : jobs )
+		{
+			if ( job . IsFinished() ) continue;
+			if ( job . id == id || job . resumes == id )
+			{
+				if ( error ) *error = "job " + std::to_string(id) + " is already queued or running";
+				return 0;
+			}
+		}
+	}
+
+	std::vector<unsigned short int> left = ScanCheckpoint::Remaining(*saved);
+	if ( left . empty() )
+	{
+		ScanCheckpoint::Remove(datadir, id);
+		if ( error ) *error = "job " + std::to_string(id) + " has no channels left";
+		return 0;
+	}
+
+	if ( gVerbose > 0 )
+	{
+		std::cout << "[kulgadd::ScanManager::Resume] Job " << id << ": " << saved -> done . size() << " channels done, " << left . size() << " to go" << std::endl;
+	}
+
+	ScanJob job = saved -> job;
+	job . channels = left;
+	job . resumes  = id;
+	return Enqueue(job);
+}
+
+
+///---------------------------------------------------------
+/// Cancel a queued or running job
+///---------------------------------------------------------
+bool ScanManager::Cancel(unsigned int id)
+{
+	std::unique_lock<std::mutex> lk(queue_mutex);
+	ScanJob* job = FindJob(id);
+	if ( !job || job -> IsFinished() ) return false;
+
+	if ( job -> state == ScanJobState::Queued )
+	{
+		job -> state = ScanJobState::Cancelled;
+		ScanJob copy = *job;
+		lk . unlock();
+		NotifyJob(copy);
+		return true;
 	}
+
+	// Running: the scheduler marks it cancelled once the child is reaped
+	job -> cancelRequested = true;
+	lk . unlock();
+	Terminate();
+	return true;
+}
+
+
+///---------------------------------------------------------
+/// Change the priority of a queued job
+///---------------------------------------------------------
+bool ScanManager::Reorder(unsigned int id, int priority)
+{
+	std::unique_lock<std::mutex> lk(queue_mutex);
+	ScanJob* job = FindJob(id);
+	if ( !job || job -> state != ScanJobState::Queued ) return false;
+
+	job -> priority = priority;
+	ScanJob copy = *job;
+	lk . unlock();
+	NotifyJob(copy);
+	return true;
+}
+
+
+///---------------------------------------------------------
+/// Get a copy of a job
+///---------------------------------------------------------
+std::optional<ScanJob> ScanManager::GetJob(unsigned int id)
+{
+	std::lock_guard<std::mutex> lk(queue_mutex);
+	ScanJob* job = FindJob(id);
+	if ( !job ) return std::nullopt;
+	return *job;
 }
 
 
 ///------------------------------------------------
 /// JSON handling: stat to JSON
 ///------------------------------------------------
-std::string ScanManager::ToJSONString() const
+std::string ScanManager::ToJSONString()
 {
+	std::lock_guard<std::mutex> lk(queue_mutex);
+	size_t queued = 0;
+	for ( const auto& job : jobs )
+	{
+		if ( job . state == ScanJobState::Queued ) queued++;
+	}
+
 	json j;
 	if ( running ) j["scan"] = 1;
 	else           j["scan"] = 0;
+	j["job"]    = current_job;
+	j["queued"] = queued;
+	return j . dump();
+}
+
+
+///------------------------------------------------
+/// JSON handling: progress of the running scan
+///------------------------------------------------
+std::string ScanManager::ProgressToJSONString()
+{
+	return progress . ToJSONString();
+}
+
+
+///------------------------------------------------
+/// JSON handling: one channel's curve of a job, or
+/// the channel list when no channel is given
+///------------------------------------------------
+std::string ScanManager::CurveToJSONString(unsigned int job, std::optional<unsigned short int> ch)
+{
+	std::lock_guard<std::mutex> lk(reader_mutex);
+
+	// The running job is read straight from the writer
+	if ( store . IsOpen() && store . GetJob() == job )
+	{
+		return ch ? store . CurveToJSONString(*ch) : store . ChannelsToJSONString();
+	}
+
+	if ( !reader . IsOpen() || reader . GetJob() != job )
+	{
+		if ( !reader . Open(ResultStore::PathFor(datadir, job)) ) return "{\"curve\":null}";
+	}
+	return ch ? reader . CurveToJSONString(*ch) : reader . ChannelsToJSONString();
+}
+
+
+///------------------------------------------------
+/// JSON handling: accounting of finished scans
+///------------------------------------------------
+std::string ScanManager::HistoryToJSONString(std::optional<unsigned int> job)
+{
+	return history . ToJSONString(job);
+}
+
+
+///------------------------------------------------
+/// JSON handling: warm worker state
+///------------------------------------------------
+std::string ScanManager::WorkerToJSONString()
+{
+	return worker . ToJSONString();
+}
+
+
+///------------------------------------------------
+/// JSON handling: resumable jobs
+///------------------------------------------------
+std::string ScanManager::CheckpointsToJSONString()
+{
+	return ScanCheckpoint::ListToJSONString(datadir);
+}
+
+
+///------------------------------------------------
+/// JSON handling: job list to JSON
+///------------------------------------------------
+std::string ScanManager::JobsToJSONString()
+{
+	std::lock_guard<std::mutex> lk(queue_mutex);
+	json j;
+	j["jobs"] = json::array();
+	for ( const auto& job : jobs )
+	{
+		j["jobs"] . push_back(json::parse(job . ToJSONString()));
+	}
 	return j . dump();
 }
 
@@ -264,32 +794,430 @@ std::string ScanManager::ToJSONString() const
 //-----------------------------------------------------------------------------
 // Private methods
 //-----------------------------------------------------------------------------
-void ScanManager::CleanupReaders()
+///---------------------------------------------------------
+/// Reactor: child exit, child output and kill timer in one epoll set
+///---------------------------------------------------------
+void ScanManager::ReactorLoop()
+{
+	constexpr int MAX_EVENTS = 8;
+	epoll_event events[MAX_EVENTS];
+
+	while ( !reactor_quit )
+	{
+		int timeout = -1;
+		{
+			std::lock_guard<std::mutex> lk(status_mutex);
+			if ( running . load() && pid_fd < 0 && pid_ > 0 ) timeout = kReapPollMs;
+		}
+
+		int n = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
+		if ( n < 0 && errno != EINTR )
+		{
+			std::cerr << "[kulgadd::ScanManager::ReactorLoop] epoll_wait: " << strerror(errno) << std::endl;
+			break;
+		}
+
+		bool exited = false;
+		for ( int i = 0; i < n; i++ )
+		{
+			int fd = events[i] . data . fd;
+			if ( fd == wake_fd )
+			{
+				uint64_t v;
+				if ( read(wake_fd, &v, sizeof(v)) < 0 ) {}
+			}
+			else if ( fd == timer_fd )
+			{
+				uint64_t v;
+				if ( read(timer_fd, &v, sizeof(v)) < 0 ) {}
+				std::lock_guard<std::mutex> lk(status_mutex);
+				if ( running . load() && pid_ > 0 )
+				{
+					if ( gVerbose > 0 ) std::cout << "[kulgadd::ScanManager::ReactorLoop] Kill timeout, sending SIGKILL" << std::endl;
+					kill(-pid_, SIGKILL);
+				}
+			}
+			else if ( fd == pid_fd )
+			{
+				exited = true;
+			}
+			else
+			{
+				OnChildOutput(fd);
+			}
+		}
+
+		// Without a pidfd, poll once per interval
+		if ( !exited && timeout > 0 ) exited = true;
+		if ( exited ) OnChildExit();
+	}
+}
+
+
+///---------------------------------------------------------
+/// Drain one output pipe
+///---------------------------------------------------------
+void ScanManager::OnChildOutput(int fd)
+{
+	char buf[4096];
+	while ( true )
+	{
+		ssize_t n = read(fd, buf, sizeof(buf));
+		if ( n > 0 )
+		{
+			if ( !first_output )
+			{
+				first_output = true;
+				auto dt = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - spawn_time) . count();
+				history . SetStartup(dt);
+				if ( gVerbose > 0 )
+				{
+					std::cout << "[kulgadd::ScanManager::OnChildOutput] First output " << dt << " ms after spawn" << std::endl;
+				}
+			}
+
+			if ( fd == progress_fd )
+			{
+				for ( const auto& ev : progress . Feed(buf, n) ) HandleEvent(ev);
+			}
+			else if ( fd == stdout_fd )
+			{
+				std::lock_guard<std::mutex> lk(stdout_mutex);
+				stdout_buf . append(buf, static_cast<size_t>(n));
+				DeliverLog("stdout", buf, n);
+			}
+			else
+			{
+				std::lock_guard<std::mutex> lk(stderr_mutex);
+				stderr_buf . append(buf, static_cast<size_t>(n));
+				DeliverLog("stderr", buf, n);
+			}
+			continue;
+		}
+		if ( n < 0 && errno == EINTR ) continue;
+		if ( n < 0 && errno == EAGAIN ) return;
+
+		// EOF or error: stop watching it
+		std::lock_guard<std::mutex> lk(status_mutex);
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+		close(fd);
+		for ( int* f : { &stdout_fd, &stderr_fd, &progress_fd } )
+		{
+			if ( *f == fd ) *f = -1;
+		}
+		return;
+	}
+}
+
+
+///---------------------------------------------------------
+/// Reap the child if it is gone
+///---------------------------------------------------------
+void ScanManager::OnChildExit()
+{
+	int status = 0;
+	struct rusage usage = {};
+	pid_t r;
+	{
+		std::lock_guard<std::mutex> lk(status_mutex);
+		if ( pid_ <= 0 ) return;
+		while ( (r = wait4(pid_, &status, WNOHANG, &usage)) < 0 && errno == EINTR );
+		if ( r == 0 ) return;
+	}
+	if ( r > 0 ) history . SetUsage(usage);
+
+	// Whatever the child wrote last is still in the pipes
+	if ( stdout_fd   >= 0 ) OnChildOutput(stdout_fd);
+	if ( stderr_fd   >= 0 ) OnChildOutput(stderr_fd);
+	if ( progress_fd >= 0 ) OnChildOutput(progress_fd);
+
+	{
+		std::lock_guard<std::mutex> lk(status_mutex);
+		if ( r == pid_ ) exit_status = status;
+		ArmTimer(timer_fd, 0);
+		pid_ = -1;
+		running . store(false);
+	}
+	CloseChildFds();
+	exit_cv . notify_all();
+}
+
+
+///---------------------------------------------------------
+/// Close whatever is left of the child's fds
+///---------------------------------------------------------
+void ScanManager::CloseChildFds()
+{
+	std::lock_guard<std::mutex> lk(status_mutex);
+	for ( int* fd : { &stdout_fd, &stderr_fd, &progress_fd, &pid_fd } )
+	{
+		if ( *fd >= 0 )
+		{
+			epoll_ctl(epoll_fd, EPOLL_CTL_DEL, *fd, nullptr);
+			close(*fd);
+			*fd = -1;
+		}
+	}
+}
+
+
+///---------------------------------------------------------
+/// Scheduler: runs queued jobs back to back
+///---------------------------------------------------------
+void ScanManager::SchedulerLoop()
+{
+	while ( true )
+	{
+		//--------------------------------------
+		// Pick the highest priority, oldest queued job
+		//--------------------------------------
+		std::unique_lock<std::mutex> lk(queue_mutex);
+		ScanJob* next = nullptr;
+		queue_cv . wait(lk, [&]
+		{
+			if ( scheduler_quit ) return true;
+			next = nullptr;
+			for ( auto& job : jobs )
+			{
+				if ( job . state != ScanJobState::Queued ) continue;
+				if ( !next || job . priority > next -> priority ) next = &job;
+			}
+			return next != nullptr;
+		});
+		if ( scheduler_quit ) break;
+
+		next -> state = ScanJobState::Running;
+		current_job = next -> id;
+		ScanJob job = *next;
+		sweep . ClearAbort();
+		worker . ClearAbort();
+		lk . unlock();
+		NotifyJob(job);
+
+		//--------------------------------------
+		// Run it to the end
+		//--------------------------------------
+		progress . Begin(job . id, job . ChannelCount(), job . PointCount());
+		live . Begin(job . id);
+		if ( !job . dryrun )
+		{
+			if ( gGrid ) pads . SetGeometry(gGrid -> GetRows(), gGrid -> GetCols());
+			pads . Begin(job . id);
+		}
+		history . Begin(job . id, job . engine);
+
+		std::error_code ec;
+		std::filesystem::create_directories(datadir, ec);
+		if ( ec ) std::cerr << "[kulgadd::ScanManager::SchedulerLoop] Cannot create " << datadir << ": " << ec . message() << std::endl;
+		if ( !job . dryrun ) OpenStore(job . id);
+
+		// The resumed job's checkpoint is superseded by this one
+		checkpoint . Begin(datadir, job);
+		if ( job . resumes ) ScanCheckpoint::Remove(datadir, job . resumes);
+
+		//--------------------------------------
+		// A cancel during the setup found nothing to stop yet. From
+		// here on, Terminate reaches the engine.
+		//--------------------------------------
+		lk . lock();
+		ScanJob* queued = FindJob(job . id);
+		bool cancelled = queued && queued -> cancelRequested;
+		if ( !cancelled && job . engine != ScanEngine::Script )
+		{
+			( job . engine == ScanEngine::Native ? native : warm ) . store(true);
+			running . store(true);
+		}
+		lk . unlock();
+
+		bool succeeded = false;
+		if ( cancelled )
+		{
+			if ( gVerbose > 0 ) std::cout << "[kulgadd::ScanManager::SchedulerLoop] Job " << job . id << " cancelled before it started" << std::endl;
+		}
+		else if ( job . engine == ScanEngine::Native )
+		{
+			succeeded = RunNative(job);
+		}
+		else if ( job . engine == ScanEngine::Worker )
+		{
+			succeeded = RunWorker(job);
+		}
+		else
+		{
+			bool started = Start(job);
+
+			// Cancelled while the child was being spawned
+			lk . lock();
+			queued = FindJob(job . id);
+			cancelled = queued && queued -> cancelRequested;
+			lk . unlock();
+			if ( started && cancelled ) Terminate();
+
+			if ( started ) Wait();
+			else std::cerr << "[kulgadd::ScanManager::SchedulerLoop] Failed to start job " << job . id << std::endl;
+
+			auto status = GetExitStatus();
+			succeeded = started && status && WIFEXITED(*status) && WEXITSTATUS(*status) == 0;
+		}
+
+		//--------------------------------------
+		// Record the outcome
+		//--------------------------------------
+		lk . lock();
+		ScanJob* done = FindJob(job . id);
+		if ( done )
+		{
+			if ( job . engine == ScanEngine::Script ) done -> exitStatus = GetExitStatus();
+			if      ( done -> cancelRequested ) done -> state = ScanJobState::Cancelled;
+			else if ( succeeded               ) done -> state = ScanJobState::Done;
+			else                                done -> state = ScanJobState::Failed;
+			job = *done;
+		}
+		current_job = 0;
+		PruneJobs();
+		lk . unlock();
+		progress . End();
+		live . End();
+		pads . End();
+		if ( !job . dryrun ) pads . Save(datadir + "/heatmap.json");
+		history . End(job . state);
+		if ( gServer && gServer -> Wants(Topic::Metrics) ) gServer -> Deliver(Topic::Metrics, history . ToJSONString(job . id));
+		checkpoint . End(job . state != ScanJobState::Done);
+		{
+			std::lock_guard<std::mutex> rlk(reader_mutex);
+			store . Close();
+		}
+		NotifyJob(job);
+	}
+}
+
+
+///---------------------------------------------------------
+/// One progress event from the child or the native engine
+///---------------------------------------------------------
+void ScanManager::HandleEvent(const ProgressEvent& ev)
+{
+	if ( ev . kind == ProgressKind::Step ) store . Append(ev . ch, ev . V, ev . I, ev . t);
+	history . Apply(ev);
+	if ( ev . kind == ProgressKind::ChannelEnd && ev . ok ) checkpoint . Complete(ev . ch);
+	if ( auto frame = live . Apply(ev); frame && gServer ) gServer -> DeliverCurve(*frame);
+	bool scanProgress = gServer && gServer -> Wants(Topic::ScanProgress);
+	if ( pads . Apply(ev) && scanProgress ) gServer -> Deliver(Topic::ScanProgress, pads . ToJSONString(), Backlog::Replace, "heatmap");
+	if ( progress . Apply(ev) && scanProgress ) gServer -> Deliver(Topic::ScanProgress, progress . ToJSONString(), Backlog::Replace, "progress");
+}
+
+
+///---------------------------------------------------------
+/// Script output to the clients following the scan log
+///---------------------------------------------------------
+void ScanManager::DeliverLog(const char* stream, const char* buf, ssize_t n)
+{
+	if ( !gServer || !gServer -> Wants(Topic::ScanLog) ) return;
+
+	json j;
+	j["log"]["stream"] = stream;
+	j["log"]["text"]   = std::string(buf, static_cast<size_t>(n));
+
+	// A chunk may end inside a UTF-8 sequence
+	gServer -> Deliver(Topic::ScanLog, j . dump(-1, ' ', false, json::error_handler_t::replace), Backlog::Drop);
+}
+
+
+///---------------------------------------------------------
+/// Start the result store of a job. Scans go on without it on failure.
+///---------------------------------------------------------
+void ScanManager::OpenStore(unsigned int job)
+{
+	if ( !store . Create(ResultStore::PathFor(datadir, job), job) )
+	{
+		std::cerr << "[kulgadd::ScanManager::OpenStore] No result store for job " << job << " in " << datadir << std::endl;
+	}
+}
+
+
+///---------------------------------------------------------
+/// Run a job on the in-daemon sweep engine
+///---------------------------------------------------------
+bool ScanManager::RunNative(const ScanJob& job)
+{
+	// running and native are set by the scheduler
+	// Each SMU sweeps on its own thread; the pool adds up their usage
+	struct rusage usage = {};
+	bool ok = sweep . Run(job, &usage);
+	history . SetUsage(usage);
+
+	running . store(false);
+	native . store(false);
+	return ok;
+}
+
+
+///---------------------------------------------------------
+/// Run a job on the warm Python worker
+///---------------------------------------------------------
+bool ScanManager::RunWorker(const ScanJob& job)
 {
-	if ( stdout_fd != -1)
+	// running and warm are set by the scheduler
+	struct rusage usage = {};
+	double startup = -1;
+	bool ok = worker . Run(job, &usage, &startup);
+	history . SetUsage(usage);
+	if ( startup >= 0 ) history . SetStartup(startup);
+
+	running . store(false);
+	warm . store(false);
+	return ok;
+}
+
+
+///---------------------------------------------------------
+/// Tell clients about a job state change
+///---------------------------------------------------------
+void ScanManager::NotifyJob(const ScanJob& job)
+{
+	if ( gVerbose > 0 )
 	{
-		::close(stdout_fd);
-		stdout_fd = -1;
+		std::cout << "[kulgadd::ScanManager::NotifyJob] Job " << job . id << " is " << ScanJob::StateName(job . state) << std::endl;
 	}
-	if ( stderr_fd != -1 )
+
+	if ( gServer && gServer -> Wants(Topic::ScanLog) ) gServer -> Deliver(Topic::ScanLog, "{\"job\":" + job . ToJSONString() + "}");
+}
+
+
+///---------------------------------------------------------
+/// Find job by id. Caller holds queue_mutex.
+///---------------------------------------------------------
+ScanJob* ScanManager::FindJob(unsigned int id)
+{
+	for ( auto& job : jobs )
 	{
-		::close(stderr_fd);
-		stderr_fd = -1;
+		if ( job . id == id ) return &job;
 	}
-	if ( stdout_thread . joinable() ) stdout_thread . join();
-	if ( stderr_thread . joinable() ) stderr_thread . join();
+	return nullptr;
 }
 
 
-void ScanManager::ReaderThread(int fd, std::string& outBuf, std::mutex& bufMutex)
+///---------------------------------------------------------
+/// Drop the oldest finished jobs. Caller holds queue_mutex.
+///---------------------------------------------------------
+void ScanManager::PruneJobs()
 {
-	if ( fd < 0 ) return;
-	constexpr size_t BUF_SZ = 4096;
-	std::vector<char> buf(BUF_SZ);
-	ssize_t n;
-	while ( (n = read(fd, buf.data(), BUF_SZ)) > 0 )
+	size_t finished = 0;
+	for ( const auto& job : jobs )
 	{
-		std::lock_guard<std::mutex> lk(bufMutex);
-		outBuf . append(buf.data(), static_cast<size_t>(n));
+		if ( job . IsFinished() ) finished++;
+	}
+
+	for ( auto it = jobs . begin(); it != jobs . end() && finished > kMaxFinishedJobs; )
+	{
+		if ( it -> IsFinished() )
+		{
+			it = jobs . erase(it);
+			finished--;
+		}
+		else
+		{
+			++it;
+		}
 	}
 }
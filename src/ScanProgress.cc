@@ -0,0 +1,264 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   ScanProgress.cc
+///
+///   The definition of ScanProgress class.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include <iostream>
+#include <nlohmann/json.hpp>
+
+#include "global.hh"
+#include "ScanProgress.hh"
+
+
+
+///-----------------------------------------------------------------------------
+/// JSON namespace
+///-----------------------------------------------------------------------------
+using json = nlohmann::json;
+
+
+
+///-----------------------------------------------------------------------------
+/// Anonymous namespace
+///-----------------------------------------------------------------------------
+namespace
+{
+	// A runaway child must not grow the line buffer without bound
+	constexpr size_t kMaxLine = 4096;
+
+	double Now()
+	{
+		return std::chrono::duration<double>(std::chrono::system_clock::now() . time_since_epoch()) . count();
+	}
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Constructors and destructors
+///-----------------------------------------------------------------------------
+ScanProgress::ScanProgress()
+	: intervalMs(250), active(false), jobId(0), channelsTotal(0), channelsDone(0),
+	  stepsPerChannel(0), currentChannel(-1), lastV(0), lastI(0), complianceHits(0), breakdowns(0)
+{
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Methods
+///-----------------------------------------------------------------------------
+///-----------------------------------------------
+/// A scan starts
+///-----------------------------------------------
+void ScanProgress::Begin(unsigned int job, size_t channels, size_t steps)
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	lineBuffer . clear();
+	active          = true;
+	jobId           = job;
+	channelsTotal   = channels;
+	channelsDone    = 0;
+	stepsPerChannel = steps;
+	openChannels . clear();
+	currentChannel  = -1;
+	lastV           = 0;
+	lastI           = 0;
+	complianceHits  = 0;
+	breakdowns      = 0;
+	startTime       = std::chrono::steady_clock::now();
+	lastPublish     = std::chrono::steady_clock::time_point();
+}
+
+
+///-----------------------------------------------
+/// The scan is over
+///-----------------------------------------------
+void ScanProgress::End()
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	active = false;
+	lineBuffer . clear();
+}
+
+
+///-----------------------------------------------
+/// Split raw bytes into lines and parse them
+///-----------------------------------------------
+std::vector<ProgressEvent> ScanProgress::Feed(const char* data, size_t len)
+{
+	std::vector<ProgressEvent> events;
+	std::lock_guard<std::mutex> lk(mutex);
+
+	for ( size_t i = 0; i < len; i++ )
+	{
+		if ( data[i] != '\n' )
+		{
+			if ( lineBuffer . size() < kMaxLine ) lineBuffer += data[i];
+			continue;
+		}
+
+		auto ev = ParseLine(lineBuffer);
+		if ( ev ) events . push_back(*ev);
+		lineBuffer . clear();
+	}
+
+	return events;
+}
+
+
+///-----------------------------------------------
+/// One JSON line to an event
+/// {"ev":"channel_start"|"step"|"channel_end"|"compliance"|"breakdown","ch":N,"V":v,"I":i,"t":s[,"ok":false]}
+///-----------------------------------------------
+std::optional<ProgressEvent> ScanProgress::ParseLine(const std::string& line)
+{
+	try
+	{
+		json j = json::parse(line);
+		std::string ev = j . at("ev") . get<std::string>();
+
+		ProgressEvent e;
+		if      ( ev == "channel_start" ) e . kind = ProgressKind::ChannelStart;
+		else if ( ev == "step"          ) e . kind = ProgressKind::Step;
+		else if ( ev == "channel_end"   ) e . kind = ProgressKind::ChannelEnd;
+		else if ( ev == "compliance"    ) e . kind = ProgressKind::Compliance;
+		else if ( ev == "breakdown"     ) e . kind = ProgressKind::Breakdown;
+		else return std::nullopt;
+
+		int ch = j . at("ch") . get<int>();
+		if ( ch < 0 || ch > 0xffff ) return std::nullopt;
+		e . ch = ch;
+		e . V  = j . value("V", 0.0);
+		e . I  = j . value("I", 0.0);
+		e . t  = j . value("t", Now());
+		e . ok = j . value("ok", true);
+		return e;
+	}
+	catch ( const std::exception& e )
+	{
+		if ( gVerbose > 1 ) std::cerr << "[kulgadd::ScanProgress::ParseLine] Bad progress line: " << line << std::endl;
+		return std::nullopt;
+	}
+}
+
+
+///-----------------------------------------------
+/// Account for one event
+///-----------------------------------------------
+bool ScanProgress::Apply(const ProgressEvent& ev)
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	if ( !active ) return false;
+
+	bool force = false;
+	switch ( ev . kind )
+	{
+		case ProgressKind::ChannelStart:
+			currentChannel = ev . ch;
+			openChannels[ev . ch] = 0;
+			force = true;
+			break;
+
+		case ProgressKind::Step:
+			currentChannel = ev . ch;
+			openChannels[ev . ch]++;
+			lastV = ev . V;
+			lastI = ev . I;
+			break;
+
+		case ProgressKind::ChannelEnd:
+			channelsDone++;
+			openChannels . erase(ev . ch);
+			force = true;
+			break;
+
+		case ProgressKind::Compliance:
+			complianceHits++;
+			lastV = ev . V;
+			lastI = ev . I;
+			force = true;
+			break;
+
+		case ProgressKind::Breakdown:
+			breakdowns++;
+			lastV = ev . V;
+			lastI = ev . I;
+			force = true;
+			break;
+	}
+
+	// Throttle everything but channel boundaries, compliance and breakdown
+	auto now = std::chrono::steady_clock::now();
+	if ( !force && now - lastPublish < std::chrono::milliseconds(intervalMs) ) return false;
+	lastPublish = now;
+	return true;
+}
+
+
+///------------------------------------------------
+/// JSON handling: progress to JSON
+///------------------------------------------------
+std::string ScanProgress::ToJSONString()
+{
+	std::lock_guard<std::mutex> lk(mutex);
+	return ToJSONStringLocked();
+}
+
+
+std::string ScanProgress::ToJSONStringLocked() const
+{
+	json p;
+	p["active"] = active;
+	p["job"]    = jobId;
+
+	if ( active )
+	{
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime) . count();
+
+		// Fraction of the whole scan, counting the steps of the channels in progress
+		double frac = 0;
+		if ( channelsTotal > 0 )
+		{
+			double inChannel = 0;
+			for ( const auto& [ch, steps] : openChannels )
+			{
+				if ( stepsPerChannel > 0 ) inChannel += std::min(1.0, double(steps) / stepsPerChannel);
+			}
+			frac = std::min(1.0, (channelsDone + inChannel) / channelsTotal);
+		}
+
+		auto current = openChannels . find(currentChannel);
+		json open = json::array();
+		for ( const auto& [ch, steps] : openChannels ) open . push_back(ch);
+
+		p["ch"]            = currentChannel;
+		p["V"]             = lastV;
+		p["I"]             = lastI;
+		p["step"]          = current != openChannels . end() ? current -> second : 0;
+		p["open"]          = open;
+		p["steps"]         = stepsPerChannel;
+		p["channelsDone"]  = channelsDone;
+		p["channelsTotal"] = channelsTotal;
+		p["compliance"]    = complianceHits;
+		p["breakdowns"]    = breakdowns;
+		p["elapsed"]       = elapsed;
+		if ( frac > 0 ) p["eta"] = elapsed * (1 - frac) / frac;
+	}
+
+	json j;
+	j["progress"] = p;
+	return j . dump();
+}
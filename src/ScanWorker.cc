@@ -0,0 +1,502 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   ScanWorker.cc
+///
+///   The definition of ScanWorker class.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include "global.hh"
+#include "ScanWorker.hh"
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <unistd.h>
+#include <signal.h>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <nlohmann/json.hpp>
+
+
+
+///-----------------------------------------------------------------------------
+/// JSON namespace
+///-----------------------------------------------------------------------------
+using json = nlohmann::json;
+
+
+
+///-----------------------------------------------------------------------------
+/// Anonymous namespace
+///-----------------------------------------------------------------------------
+namespace
+{
+	constexpr int kWorkerFd      = 3;
+	constexpr int kReadyTimeout  = 60000;  // ms; the imports take a while
+	constexpr int kAbortGrace    = 5000;   // ms from SIGINT to SIGKILL
+	constexpr int kMaxBackoff    = 30000;  // ms between failed launches
+	constexpr size_t kMaxLine    = 4096;
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Constructors and destructors
+///-----------------------------------------------------------------------------
+ScanWorker::ScanWorker()
+	: script("/sw/kulgadd/dev/source/scripts/scan_worker.py"), recycleAfter(20),
+	  pid(-1), sock(-1), jobsServed(0), restarts(0), busyPid(-1), abortRequested(false),
+	  quit(false), backoffMs(1000)
+{
+}
+
+
+ScanWorker::~ScanWorker()
+{
+	Stop();
+
+	std::lock_guard<std::mutex> lk(mutex);
+	Shutdown();
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Public methods
+///-----------------------------------------------------------------------------
+///---------------------------------------------------------
+/// Start supervising
+///---------------------------------------------------------
+void ScanWorker::Start()
+{
+	if ( supervisor . joinable() ) return;
+
+	{
+		std::lock_guard<std::mutex> lk(quit_mutex);
+		quit = false;
+	}
+	nextLaunch = std::chrono::steady_clock::now();
+	supervisor = std::thread(&ScanWorker::SuperviseLoop, this);
+}
+
+
+///---------------------------------------------------------
+/// Stop supervising. The worker itself goes with the destructor.
+///---------------------------------------------------------
+void ScanWorker::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lk(quit_mutex);
+		quit = true;
+	}
+	quit_cv . notify_all();
+	if ( supervisor . joinable() ) supervisor . join();
+}
+
+
+///---------------------------------------------------------
+/// Run one job on the worker
+///---------------------------------------------------------
+bool ScanWorker::Run(const ScanJob& job, struct rusage* usage, double* startup_ms)
+{
+	std::lock_guard<std::mutex> lk(mutex);
+
+	if ( pid <= 0 && !Launch() ) return false;
+	if ( abortRequested ) return false;
+
+	double user0 = 0, sys0 = 0;
+	long rss = 0;
+	ReadUsage(pid, user0, sys0, rss);
+
+	json req;
+	req["cmd"] = "run";
+	req["job"] = json::parse(job . ToJSONString());
+	req["nchannels"] = job . ChannelCount();  // What an empty channel list means
+	auto sent = std::chrono::steady_clock::now();
+	if ( !WriteLine(req . dump()) )
+	{
+		std::cerr << "[kulgadd::ScanWorker::Run] Cannot send job " << job . id << std::endl;
+		Shutdown();
+		return false;
+	}
+	busyPid = pid;
+	if ( abortRequested ) kill(pid, SIGINT);
+
+	//--------------------------------------
+	// Events until job_end, abort or crash
+	//--------------------------------------
+	bool ok = false;
+	bool first = true;
+	while ( true )
+	{
+		bool eof = false;
+		auto line = ReadLine(200, eof);
+		if ( eof )
+		{
+			std::cerr << "[kulgadd::ScanWorker::Run] Worker " << pid << " died during job " << job . id << std::endl;
+			Shutdown();
+			restarts++;
+			break;
+		}
+
+		if ( !line )
+		{
+			// SIGINT ignored: the worker is stuck, take it down
+			if ( abortRequested && std::chrono::steady_clock::now() - abortTime > std::chrono::milliseconds(kAbortGrace) )
+			{
+				std::cerr << "[kulgadd::ScanWorker::Run] Worker " << pid << " ignores the abort, killing it" << std::endl;
+				kill(-pid, SIGKILL);
+			}
+			continue;
+		}
+
+		if ( first && startup_ms )
+		{
+			*startup_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sent) . count();
+		}
+		first = false;
+
+		try
+		{
+			json j = json::parse(*line);
+			if ( j . value("ev", "") == "job_end" )
+			{
+				ok = j . value("ok", false);
+				if ( !ok && gVerbose > 0 )
+				{
+					std::cerr << "[kulgadd::ScanWorker::Run] Job " << job . id << " failed: " << j . value("error", json()) . dump() << std::endl;
+				}
+				break;
+			}
+		}
+		catch ( const std::exception& e )
+		{
+			continue;
+		}
+
+		auto ev = ScanProgress::ParseLine(*line);
+		if ( ev && listener ) listener(*ev);
+	}
+	busyPid = -1;
+
+	//--------------------------------------
+	// Account and recycle
+	//--------------------------------------
+	if ( pid > 0 )
+	{
+		double user1 = 0, sys1 = 0;
+		if ( usage && ReadUsage(pid, user1, sys1, rss) )
+		{
+			*usage = {};
+			usage -> ru_utime . tv_sec  = static_cast<time_t>(user1 - user0);
+			usage -> ru_utime . tv_usec = static_cast<suseconds_t>((user1 - user0 - usage -> ru_utime . tv_sec) * 1e6);
+			usage -> ru_stime . tv_sec  = static_cast<time_t>(sys1 - sys0);
+			usage -> ru_stime . tv_usec = static_cast<suseconds_t>((sys1 - sys0 - usage -> ru_stime . tv_sec) * 1e6);
+			usage -> ru_maxrss = rss;
+		}
+
+		jobsServed++;
+		if ( recycleAfter > 0 && jobsServed >= recycleAfter )
+		{
+			if ( gVerbose > 0 )
+			{
+				std::cout << "[kulgadd::ScanWorker::Run] Recycling worker " << pid << " after " << jobsServed << " jobs" << std::endl;
+			}
+			Shutdown();
+		}
+	}
+
+	// Let the supervisor bring up the next one right away
+	nextLaunch = std::chrono::steady_clock::now();
+	quit_cv . notify_all();
+	return ok;
+}
+
+
+///---------------------------------------------------------
+/// Interrupt the running job. The worker survives it.
+///---------------------------------------------------------
+void ScanWorker::Abort()
+{
+	abortTime = std::chrono::steady_clock::now();
+	abortRequested = true;
+
+	pid_t p = busyPid . load();
+	if ( p > 0 ) kill(p, SIGINT);
+}
+
+
+///------------------------------------------------
+/// JSON handling: worker state
+///------------------------------------------------
+std::string ScanWorker::ToJSONString()
+{
+	json w;
+	w["busy"]     = busyPid . load() > 0;
+	w["restarts"] = restarts;
+
+	std::unique_lock<std::mutex> lk(mutex, std::try_to_lock);
+	if ( lk . owns_lock() )
+	{
+		w["pid"]  = pid;
+		w["jobs"] = jobsServed;
+	}
+
+	json j;
+	j["worker"] = w;
+	return j . dump();
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Private methods
+///-----------------------------------------------------------------------------
+///---------------------------------------------------------
+/// Keep a worker up: reap crashes, relaunch with backoff
+///---------------------------------------------------------
+void ScanWorker::SuperviseLoop()
+{
+	std::unique_lock<std::mutex> qlk(quit_mutex);
+	while ( !quit )
+	{
+		quit_cv . wait_for(qlk, std::chrono::milliseconds(500));
+		if ( quit ) break;
+		qlk . unlock();
+
+		// A job in progress has the worker; look again later
+		std::unique_lock<std::mutex> lk(mutex, std::try_to_lock);
+		if ( lk . owns_lock() )
+		{
+			if ( pid > 0 && Reap(false) )
+			{
+				std::cerr << "[kulgadd::ScanWorker::SuperviseLoop] Worker exited while idle" << std::endl;
+				restarts++;
+				nextLaunch = std::chrono::steady_clock::now();
+			}
+
+			if ( pid <= 0 && std::chrono::steady_clock::now() >= nextLaunch )
+			{
+				if ( Launch() ) backoffMs = 1000;
+				else
+				{
+					nextLaunch = std::chrono::steady_clock::now() + std::chrono::milliseconds(backoffMs);
+					backoffMs = std::min(2 * backoffMs, kMaxBackoff);
+				}
+			}
+		}
+		lk = std::unique_lock<std::mutex>();
+
+		qlk . lock();
+	}
+}
+
+
+///---------------------------------------------------------
+/// Spawn a worker and wait until it says ready. Caller holds mutex.
+///---------------------------------------------------------
+bool ScanWorker::Launch()
+{
+	int sv[2];
+	if ( socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0 )
+	{
+		std::cerr << "[kulgadd::ScanWorker::Launch] socketpair: " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	// stdout and stderr stay the daemon's, so the worker's log goes with ours
+	auto t0 = std::chrono::steady_clock::now();
+	pid_t p = ScanManager::Spawn({ "python3", script }, { { sv[1], kWorkerFd } },
+	                             { "KULGADD_WORKER_FD=" + std::to_string(kWorkerFd) });
+	close(sv[1]);
+	if ( p < 0 )
+	{
+		close(sv[0]);
+		return false;
+	}
+
+	pid = p;
+	sock = sv[0];
+	lineBuffer . clear();
+	jobsServed = 0;
+
+	bool eof = false;
+	auto line = ReadLine(kReadyTimeout, eof);
+	bool ready = false;
+	if ( line )
+	{
+		try
+		{
+			ready = json::parse(*line) . value("ev", "") == "ready";
+		}
+		catch ( const std::exception& e )
+		{
+		}
+	}
+
+	if ( !ready )
+	{
+		std::cerr << "[kulgadd::ScanWorker::Launch] Worker " << p << " did not come up" << std::endl;
+		Shutdown();
+		return false;
+	}
+
+	if ( gVerbose > 0 )
+	{
+		auto dt = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0) . count();
+		std::cout << "[kulgadd::ScanWorker::Launch] Worker " << p << " ready in " << dt << " ms" << std::endl;
+	}
+	return true;
+}
+
+
+///---------------------------------------------------------
+/// Ask the worker to quit, then make sure. Caller holds mutex.
+///---------------------------------------------------------
+void ScanWorker::Shutdown()
+{
+	if ( sock >= 0 )
+	{
+		WriteLine("{\"cmd\":\"quit\"}");
+		close(sock);
+		sock = -1;
+	}
+	if ( pid <= 0 ) return;
+
+	for ( int i = 0; i < 20; i++ )
+	{
+		if ( Reap(false) ) return;
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+	kill(-pid, SIGTERM);
+	for ( int i = 0; i < 20; i++ )
+	{
+		if ( Reap(false) ) return;
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+	kill(-pid, SIGKILL);
+	Reap(true);
+}
+
+
+///---------------------------------------------------------
+/// True once the worker is gone. Caller holds mutex.
+///---------------------------------------------------------
+bool ScanWorker::Reap(bool block)
+{
+	if ( pid <= 0 ) return true;
+
+	int status;
+	pid_t r;
+	while ( (r = waitpid(pid, &status, block ? 0 : WNOHANG)) < 0 && errno == EINTR );
+	if ( r == 0 ) return false;
+
+	if ( sock >= 0 )
+	{
+		close(sock);
+		sock = -1;
+	}
+	pid = -1;
+	return true;
+}
+
+
+///---------------------------------------------------------
+/// One line to the worker
+///---------------------------------------------------------
+bool ScanWorker::WriteLine(const std::string& line)
+{
+	std::string msg = line + "\n";
+	size_t done = 0;
+	while ( done < msg . size() )
+	{
+		ssize_t n = send(sock, msg . data() + done, msg . size() - done, MSG_NOSIGNAL);
+		if ( n < 0 && errno == EINTR ) continue;
+		if ( n <= 0 ) return false;
+		done += n;
+	}
+	return true;
+}
+
+
+///---------------------------------------------------------
+/// One line from the worker, or nothing within the timeout
+///---------------------------------------------------------
+std::optional<std::string> ScanWorker::ReadLine(int timeout_ms, bool& eof)
+{
+	eof = false;
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+	while ( true )
+	{
+		size_t nl = lineBuffer . find('\n');
+		if ( nl != std::string::npos )
+		{
+			std::string line = lineBuffer . substr(0, nl);
+			lineBuffer . erase(0, nl + 1);
+			return line;
+		}
+
+		int left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()) . count();
+		if ( left <= 0 ) return std::nullopt;
+
+		pollfd pfd = { sock, POLLIN, 0 };
+		int r = poll(&pfd, 1, left);
+		if ( r < 0 && errno == EINTR ) continue;
+		if ( r <= 0 ) return std::nullopt;
+
+		char buf[4096];
+		ssize_t n = recv(sock, buf, sizeof(buf), 0);
+		if ( n < 0 && errno == EINTR ) continue;
+		if ( n <= 0 )
+		{
+			eof = true;
+			return std::nullopt;
+		}
+
+		// A runaway line is dropped rather than buffered without bound
+		lineBuffer . append(buf, n);
+		if ( lineBuffer . size() > kMaxLine && lineBuffer . find('\n') == std::string::npos ) lineBuffer . clear();
+	}
+}
+
+
+///---------------------------------------------------------
+/// CPU seconds and peak RSS (kB) of a live process, from /proc
+///---------------------------------------------------------
+bool ScanWorker::ReadUsage(pid_t p, double& user, double& sys, long& maxRSS)
+{
+	std::ifstream stat("/proc/" + std::to_string(p) + "/stat");
+	std::string content;
+	if ( !std::getline(stat, content) ) return false;
+
+	// Fields after the command name, which may contain spaces
+	size_t close = content . rfind(')');
+	if ( close == std::string::npos ) return false;
+	unsigned long utime = 0, stime = 0;
+	if ( sscanf(content . c_str() + close + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2 ) return false;
+
+	double tick = sysconf(_SC_CLK_TCK);
+	user = utime / tick;
+	sys  = stime / tick;
+
+	std::ifstream status("/proc/" + std::to_string(p) + "/status");
+	std::string line;
+	while ( std::getline(status, line) )
+	{
+		if ( line . compare(0, 6, "VmHWM:") == 0 ) maxRSS = atol(line . c_str() + 6);
+	}
+	return true;
+}
@@ -175,6 +175,57 @@ std::optional<std::string> SerialManager::GetBufferedResponse()
 /// Send ON/OFF
 ///---------------------------------------------------------
 bool SerialManager::SetPinStat(unsigned short int index, bool val)
+{
+	std::lock_guard<std::mutex> lock(switchMutex);
+	return SwitchPin(index, val);
+}
+
+
+///---------------------------------------------------------
+/// Send ON/OFF for several pins at once
+///---------------------------------------------------------
+bool SerialManager::SetPinStats(const std::vector<std::pair<unsigned short int, bool>>& pins)
+{
+	std::lock_guard<std::mutex> lock(switchMutex);
+
+	//--------------------------------------
+	// Break before make: two channels are never on together
+	// unless asked to be
+	//--------------------------------------
+	std::vector<std::pair<unsigned short int, bool>> order;
+	for ( const auto& p : pins ) if ( !p . second ) order . push_back(p);
+	for ( const auto& p : pins ) if (  p . second ) order . push_back(p);
+
+	size_t done = 0;
+	for ( ; done < order . size(); ++done )
+	{
+		if ( !SwitchPin(order[done] . first, order[done] . second) ) break;
+	}
+	if ( done == order . size() ) return true;
+
+	//--------------------------------------
+	// Undo, last switched first
+	//--------------------------------------
+	std::cerr << "[kulgadd::SerialManager::SetPinStats] Failed at pin " << order[done] . first << ", undoing " << done << " pins" << std::endl;
+	while ( done-- > 0 )
+	{
+		if ( !SwitchPin(order[done] . first, !order[done] . second) )
+		{
+			std::cerr << "[kulgadd::SerialManager::SetPinStats] Cannot undo pin " << order[done] . first << std::endl;
+		}
+	}
+	return false;
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Private methods
+///-----------------------------------------------------------------------------
+///---------------------------------------------------------
+/// Send ON/OFF. Caller holds switchMutex.
+///---------------------------------------------------------
+bool SerialManager::SwitchPin(unsigned short int index, bool val)
 {
 	//--------------------------------------
 	// Try set
@@ -203,16 +254,12 @@ bool SerialManager::SetPinStat(unsigned short int index, bool val)
 	}
 	else
 	{
-		std::cerr << "[kulgadd::SerialManager::SetPinStat] Try to set stat of pin " << index << " to " << val << ", but no response." << std::endl;
+		std::cerr << "[kulgadd::SerialManager::SwitchPin] Try to set stat of pin " << index << " to " << val << ", but no response." << std::endl;
 		return false;
 	}
 }
 
 
-
-///-----------------------------------------------------------------------------
-/// Private methods
-///-----------------------------------------------------------------------------
 ///---------------------------------------------------------
 /// Monitor serial's return
 ///---------------------------------------------------------
@@ -243,7 +290,7 @@ void SerialManager::MonitorSerial()
 						responseBuffer = line;
 					}
 					if ( gVerbose > 0 ) std::cout << "[kulgadd::SerialManager::Monitor] " << line << std::endl;
-					gServer -> Deliver(line);
+					if ( gServer -> Wants(Topic::SerialRaw) ) gServer -> Deliver(Topic::SerialRaw, line, Backlog::Drop);
 					line . clear();
 
 					//------------------
@@ -0,0 +1,304 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   SmuLink.cc
+///
+///   The definition of SmuLink class.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include "global.hh"
+#include "SmuLink.hh"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+
+
+
+///-----------------------------------------------------------------------------
+/// Constructors and destructors
+///-----------------------------------------------------------------------------
+///---------------------------------------------------------
+/// Constructors
+///---------------------------------------------------------
+SmuLink::SmuLink()
+{
+}
+
+SmuLink::SmuLink(const std::string& url_) : url(url_)
+{
+}
+
+
+///---------------------------------------------------------
+/// Destructor
+///---------------------------------------------------------
+SmuLink::~SmuLink()
+{
+	Close();
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Public methods
+///-----------------------------------------------------------------------------
+///---------------------------------------------------------
+/// Open the link
+///---------------------------------------------------------
+bool SmuLink::Open()
+{
+	//--------------------------------------
+	// Debugging message
+	//--------------------------------------
+	if ( gVerbose > 1 )
+	{
+		std::cout << "[kulgadd::SmuLink::Open] Try to open " << url << std::endl;
+	}
+
+	Close();
+
+	const std::string tcp = "tcp://";
+	if ( url . compare(0, tcp . size(), tcp) == 0 )
+	{
+		std::string hostport = url . substr(tcp . size());
+		size_t colon = hostport . rfind(':');
+		if ( colon == std::string::npos )
+		{
+			std::cerr << "[kulgadd::SmuLink::Open] Missing port in " << url << std::endl;
+			return false;
+		}
+		return OpenTCP(hostport . substr(0, colon), hostport . substr(colon + 1));
+	}
+
+	return OpenSerial(url);
+}
+
+
+///---------------------------------------------------------
+/// Close the link
+///---------------------------------------------------------
+void SmuLink::Close()
+{
+	if ( fd >= 0 )
+	{
+		close(fd);
+		fd = -1;
+	}
+	rxBuffer . clear();
+}
+
+
+///---------------------------------------------------------
+/// Write a line
+///---------------------------------------------------------
+bool SmuLink::WriteLine(const std::string& line)
+{
+	if ( gVerbose > 2 )
+	{
+		std::cout << "[kulgadd::SmuLink::WriteLine] " << line << std::endl;
+	}
+
+	if ( fd < 0 ) return false;
+
+	std::string msg = line + "\n";
+	size_t off = 0;
+	while ( off < msg . size() )
+	{
+		ssize_t n = write(fd, msg . data() + off, msg . size() - off);
+		if ( n < 0 )
+		{
+			if ( errno == EINTR ) continue;
+			std::cerr << "[kulgadd::SmuLink::WriteLine] " << strerror(errno) << std::endl;
+			return false;
+		}
+		off += n;
+	}
+	return true;
+}
+
+
+///---------------------------------------------------------
+/// Read a line, without the terminator
+///---------------------------------------------------------
+std::optional<std::string> SmuLink::ReadLine(int timeout_ms)
+{
+	if ( fd < 0 ) return std::nullopt;
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+	while ( true )
+	{
+		size_t eol = rxBuffer . find('\n');
+		if ( eol != std::string::npos )
+		{
+			std::string line = rxBuffer . substr(0, eol);
+			rxBuffer . erase(0, eol + 1);
+			if ( !line . empty() && line . back() == '\r' ) line . pop_back();
+			return line;
+		}
+
+		int left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()) . count();
+		if ( left <= 0 ) break;
+
+		pollfd pfd = { fd, POLLIN, 0 };
+		int r = poll(&pfd, 1, left);
+		if ( r < 0 && errno == EINTR ) continue;
+		if ( r <= 0 ) break;
+
+		char buf[256];
+		ssize_t n = read(fd, buf, sizeof(buf));
+		if ( n <= 0 ) break;
+		rxBuffer . append(buf, n);
+	}
+
+	std::cerr << "[kulgadd::SmuLink::ReadLine] Timed out waiting for " << url << std::endl;
+
+	// Half a line, or a late answer on its way, must not pass for the next one
+	Flush();
+	return std::nullopt;
+}
+
+
+///---------------------------------------------------------
+/// Write a query and read its answer
+///---------------------------------------------------------
+std::optional<std::string> SmuLink::Query(const std::string& line, int timeout_ms)
+{
+	// Only the answer to this query may come back
+	Flush();
+	if ( !WriteLine(line) ) return std::nullopt;
+	return ReadLine(timeout_ms);
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Private methods
+///-----------------------------------------------------------------------------
+///---------------------------------------------------------
+/// TCP, e.g. a LAN instrument or a local simulator
+///---------------------------------------------------------
+bool SmuLink::OpenTCP(const std::string& host, const std::string& port)
+{
+	addrinfo hints = {};
+	hints . ai_family = AF_UNSPEC;
+	hints . ai_socktype = SOCK_STREAM;
+
+	addrinfo* res = nullptr;
+	int err = getaddrinfo(host . c_str(), port . c_str(), &hints, &res);
+	if ( err != 0 )
+	{
+		std::cerr << "[kulgadd::SmuLink::OpenTCP] " << host << ": " << gai_strerror(err) << std::endl;
+		return false;
+	}
+
+	for ( addrinfo* ai = res; ai; ai = ai -> ai_next )
+	{
+		int s = socket(ai -> ai_family, ai -> ai_socktype | SOCK_CLOEXEC, ai -> ai_protocol);
+		if ( s < 0 ) continue;
+		if ( connect(s, ai -> ai_addr, ai -> ai_addrlen) == 0 )
+		{
+			// SCPI is strictly request/response, do not batch small writes
+			int one = 1;
+			setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+			fd = s;
+			break;
+		}
+		close(s);
+	}
+	freeaddrinfo(res);
+
+	if ( fd < 0 )
+	{
+		std::cerr << "[kulgadd::SmuLink::OpenTCP] Failed to connect to " << host << ":" << port << std::endl;
+		return false;
+	}
+	return true;
+}
+
+
+///---------------------------------------------------------
+/// Serial, the same raw setup as the switch controller
+///---------------------------------------------------------
+bool SmuLink::OpenSerial(const std::string& dev)
+{
+	int s = open(dev . c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if ( s < 0 )
+	{
+		std::cerr << "[kulgadd::SmuLink::OpenSerial] Failed to open " << dev << ": " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	struct termios tty;
+	if ( tcgetattr(s, &tty) != 0 )
+	{
+		std::cerr << "[kulgadd::SmuLink::OpenSerial] tcgetattr error: " << strerror(errno) << std::endl;
+		close(s);
+		return false;
+	}
+
+	cfmakeraw(&tty);
+	cfsetspeed(&tty, B9600);
+	tty . c_cflag |= (CLOCAL | CREAD);
+	tty . c_cflag &= ~CRTSCTS;
+	tty . c_cc[VMIN] = 0;
+	tty . c_cc[VTIME] = 0;
+
+	if ( tcsetattr(s, TCSANOW, &tty) != 0 )
+	{
+		std::cerr << "[kulgadd::SmuLink::OpenSerial] tcsetattr error: " << strerror(errno) << std::endl;
+		close(s);
+		return false;
+	}
+
+	// Whatever the instrument said before we opened is nobody's answer
+	tcflush(s, TCIFLUSH);
+
+	fd = s;
+	return true;
+}
+
+
+///---------------------------------------------------------
+/// Drop input nobody waits for, e.g. the late answer to a query
+/// that timed out. It would otherwise pass for the next answer.
+///---------------------------------------------------------
+void SmuLink::Flush()
+{
+	size_t dropped = rxBuffer . size();
+	rxBuffer . clear();
+
+	if ( fd >= 0 )
+	{
+		char buf[256];
+		pollfd pfd = { fd, POLLIN, 0 };
+		while ( poll(&pfd, 1, 0) > 0 && (pfd . revents & POLLIN) )
+		{
+			ssize_t n = read(fd, buf, sizeof(buf));
+			if ( n <= 0 ) break;
+			dropped += n;
+		}
+	}
+
+	if ( dropped > 0 )
+	{
+		std::cerr << "[kulgadd::SmuLink::Flush] Dropped " << dropped << " stale bytes from " << url << std::endl;
+	}
+}
@@ -0,0 +1,452 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   SweepEngine.cc
+///
+///   The definition of SweepEngine class.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include "global.hh"
+#include "SweepEngine.hh"
+#include "BreakdownDetector.hh"
+#include "VoltageStepper.hh"
+
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+
+
+
+///-----------------------------------------------------------------------------
+/// Static members
+///-----------------------------------------------------------------------------
+std::mutex SweepEngine::relayMutex;
+
+
+
+///-----------------------------------------------------------------------------
+/// Constructors and destructors
+///-----------------------------------------------------------------------------
+///---------------------------------------------------------
+/// Constructor
+///---------------------------------------------------------
+SweepEngine::SweepEngine() : relaySettleMs(50), stepSettleMs(100), outputV(0), firstRow(0), lastRow(0xffff), closedRelay(-1)
+{
+	//--------------------------------------
+	// Debugging message
+	//--------------------------------------
+	if ( gVerbose > 1 )
+	{
+		std::cout << "[kulgadd::SweepEngine] Constructed." << std::endl;
+	}
+}
+
+
+///---------------------------------------------------------
+/// Destructor
+///---------------------------------------------------------
+SweepEngine::~SweepEngine()
+{
+	//--------------------------------------
+	// Debugging message
+	//--------------------------------------
+	if ( gVerbose > 1 )
+	{
+		std::cout << "[kulgadd::SweepEngine] Destructed." << std::endl;
+	}
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Public methods
+///-----------------------------------------------------------------------------
+///---------------------------------------------------------
+/// Settling times
+///---------------------------------------------------------
+void SweepEngine::SetSettle(int relay_ms, int step_ms)
+{
+	relaySettleMs = relay_ms;
+	stepSettleMs  = step_ms;
+}
+
+
+///---------------------------------------------------------
+/// Matrix bank
+///---------------------------------------------------------
+void SweepEngine::SetBank(int first_row, int last_row)
+{
+	firstRow = first_row;
+	lastRow  = last_row;
+}
+
+
+bool SweepEngine::InBank(unsigned short int ch) const
+{
+	int row = gGrid ? ch / gGrid -> GetCols() : ch / 16;
+	return row >= firstRow && row <= lastRow;
+}
+
+
+///---------------------------------------------------------
+/// Run a job
+///---------------------------------------------------------
+bool SweepEngine::Run(const ScanJob& job)
+{
+	//--------------------------------------
+	// Debugging message
+	//--------------------------------------
+	if ( gVerbose > 0 )
+	{
+		std::cout << "[kulgadd::SweepEngine::Run] Native sweep of job " << job . id << std::endl;
+	}
+
+	// A relay left closed by the last job must open before anything else
+	if ( closedRelay >= 0 && !SetRelay(closedRelay, false) ) return false;
+
+	std::vector<unsigned short int> channels = job . channels;
+	if ( channels . empty() )
+	{
+		if ( !gGrid )
+		{
+			std::cerr << "[kulgadd::SweepEngine::Run] No pin grid to take the channels from" << std::endl;
+			return false;
+		}
+		for ( unsigned short int ch = 0; ch < gGrid -> GetTotal(); ch++ ) channels . push_back(ch);
+	}
+
+	//--------------------------------------
+	// Dry run only moves the relays
+	//--------------------------------------
+	if ( job . dryrun )
+	{
+		for ( unsigned short int ch : channels )
+		{
+			if ( abortRequested ) return false;
+			Emit(ProgressKind::ChannelStart, ch);
+			if ( !MayClose(ch) || !SetRelay(ch, true) )
+			{
+				Emit(ProgressKind::ChannelEnd, ch, 0, 0, false);
+				return false;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(relaySettleMs));
+			if ( !SetRelay(ch, false) )
+			{
+				Emit(ProgressKind::ChannelEnd, ch, 0, 0, false);
+				return false;
+			}
+			Emit(ProgressKind::ChannelEnd, ch);
+		}
+		return true;
+	}
+
+	//--------------------------------------
+	// Measure
+	//--------------------------------------
+	if ( !smu . Open() ) return false;
+	if ( !ConfigureSMU(job) )
+	{
+		ShutdownSMU(job);
+		return false;
+	}
+
+	std::string dir = job . basepath . empty() ? DefaultBasePath() : job . basepath;
+
+	bool ok = true;
+	for ( unsigned short int ch : channels )
+	{
+		if ( abortRequested ) break;
+
+		std::vector<IVPoint> points;
+		ok = SweepChannel(job, ch, points);
+		WriteChannel(dir, job, ch, points);
+		if ( !ok ) break;
+	}
+
+	ShutdownSMU(job);
+	return ok && !abortRequested;
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Private methods
+///-----------------------------------------------------------------------------
+///---------------------------------------------------------
+/// SMU setup: source voltage, measure current
+///---------------------------------------------------------
+bool SweepEngine::ConfigureSMU(const ScanJob& job)
+{
+	char prot[64];
+	snprintf(prot, sizeof(prot), ":SENS:CURR:PROT %g", job . Icompliance);
+
+	const char* setup[] =
+	{
+		"*RST",
+		":SOUR:FUNC VOLT",
+		":SOUR:VOLT:MODE FIXED",
+		":SOUR:VOLT 0",
+		":SENS:FUNC \"CURR\"",
+		prot,
+		":FORM:ELEM VOLT,CURR",
+		":OUTP ON"
+	};
+
+	for ( const char* line : setup )
+	{
+		if ( !smu . WriteLine(line) ) return false;
+	}
+	outputV = 0;
+
+	// Make sure the instrument took it all before the first step
+	return smu . Query("*OPC?") . has_value();
+}
+
+
+///---------------------------------------------------------
+/// Bring the output down and switch it off
+///---------------------------------------------------------
+void SweepEngine::ShutdownSMU(const ScanJob& job)
+{
+	if ( smu . IsOpen() )
+	{
+		RampTo(0, RampStep(job));
+		smu . WriteLine(":OUTP OFF");
+	}
+	smu . Close();
+}
+
+
+///---------------------------------------------------------
+/// One channel: close relay, sweep, ramp down, open relay
+///---------------------------------------------------------
+bool SweepEngine::SweepChannel(const ScanJob& job, unsigned short int ch, std::vector<IVPoint>& points)
+{
+	if ( gVerbose > 0 )
+	{
+		std::cout << "[kulgadd::SweepEngine::SweepChannel] Channel " << ch << std::endl;
+	}
+
+	Emit(ProgressKind::ChannelStart, ch);
+	// Sweeping an open circuit would record nothing but noise
+	if ( !MayClose(ch) || !SetRelay(ch, true) )
+	{
+		Emit(ProgressKind::ChannelEnd, ch, 0, 0, false);
+		return false;
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(relaySettleMs));
+
+	bool ok = true;
+	bool stopped = false;
+	BreakdownDetector breakdown(job);
+	VoltageStepper stepper(job);
+
+	// Bias up to Vstart in steps, the way it comes down, not in one jump from 0 V
+	if ( !RampTo(job . Vstart, RampStep(job)) ) ok = false;
+
+	for ( auto v = stepper . Next(); ok && v; v = stepper . Next() )
+	{
+		if ( abortRequested ) break;
+
+		auto point = Measure(ch, *v);
+		if ( !point )
+		{
+			ok = false;
+			break;
+		}
+		points . push_back(*point);
+		stepper . Feed(point -> V, point -> I);
+		Emit(ProgressKind::Step, ch, point -> V, point -> I);
+		if ( std::abs(point -> I) >= 0.999 * job . Icompliance ) Emit(ProgressKind::Compliance, ch, point -> V, point -> I);
+
+		// Broken down: no point going further
+		if ( breakdown . Feed(point -> V, point -> I) )
+		{
+			if ( gVerbose > 0 )
+			{
+				std::cout << "[kulgadd::SweepEngine::SweepChannel] Channel " << ch << " broke down at " << point -> V << " V (" << breakdown . Reason() << ")" << std::endl;
+			}
+			Emit(ProgressKind::Breakdown, ch, point -> V, point -> I);
+			stopped = true;
+			break;
+		}
+	}
+
+	// Never switch a relay under bias
+	if ( !RampTo(0, RampStep(job)) ) ok = false;
+	if ( !SetRelay(ch, false) ) ok = false;
+	Emit(ProgressKind::ChannelEnd, ch, 0, 0, ok && (stopped || stepper . Finished()));
+
+	return ok;
+}
+
+
+///---------------------------------------------------------
+/// Step the output to a voltage no faster than one step at a time
+///---------------------------------------------------------
+bool SweepEngine::RampTo(double target, double step)
+{
+	while ( std::abs(outputV - target) > 1e-9 )
+	{
+		double next = outputV + std::copysign(std::min(std::abs(step), std::abs(target - outputV)), target - outputV);
+		char cmd[64];
+		snprintf(cmd, sizeof(cmd), ":SOUR:VOLT %g", next);
+		if ( !smu . WriteLine(cmd) ) return false;
+		outputV = next;
+		std::this_thread::sleep_for(std::chrono::milliseconds(stepSettleMs));
+	}
+	return true;
+}
+
+
+///---------------------------------------------------------
+/// Step of the ramps up to Vstart and down to 0 V. Adaptive sweeps
+/// may start with a tiny Vstep; their largest step is the one known
+/// to be safe.
+///---------------------------------------------------------
+double SweepEngine::RampStep(const ScanJob& job)
+{
+	if ( job . stepping == Stepping::Adaptive ) return std::max(job . Vstep, job . VstepMax);
+	return job . Vstep;
+}
+
+
+///---------------------------------------------------------
+/// Apply a voltage and read back (V, I)
+///---------------------------------------------------------
+std::optional<IVPoint> SweepEngine::Measure(unsigned short int ch, double v)
+{
+	char cmd[64];
+	snprintf(cmd, sizeof(cmd), ":SOUR:VOLT %g", v);
+	if ( !smu . WriteLine(cmd) ) return std::nullopt;
+	outputV = v;
+	std::this_thread::sleep_for(std::chrono::milliseconds(stepSettleMs));
+
+	auto reply = smu . Query(":READ?");
+	if ( !reply ) return std::nullopt;
+
+	IVPoint p;
+	p . channel = ch;
+	if ( sscanf(reply -> c_str(), "%lf,%lf", &p . V, &p . I) != 2 )
+	{
+		std::cerr << "[kulgadd::SweepEngine::Measure] Unexpected reply: " << *reply << std::endl;
+		return std::nullopt;
+	}
+	p . t = std::chrono::duration<double>(std::chrono::system_clock::now() . time_since_epoch()) . count();
+
+	if ( gVerbose > 1 )
+	{
+		std::cout << "[kulgadd::SweepEngine::Measure] ch " << ch << " V " << p . V << " I " << p . I << std::endl;
+	}
+
+	return p;
+}
+
+
+///---------------------------------------------------------
+/// Matrix constraints: only our own rows, and one pad on our SMU at a time
+///---------------------------------------------------------
+bool SweepEngine::MayClose(unsigned short int ch) const
+{
+	if ( !InBank(ch) )
+	{
+		std::cerr << "[kulgadd::SweepEngine::MayClose] Channel " << ch << " is outside rows " << firstRow << "-" << lastRow << std::endl;
+		return false;
+	}
+	if ( closedRelay >= 0 && closedRelay != ch )
+	{
+		std::cerr << "[kulgadd::SweepEngine::MayClose] Channel " << closedRelay << " is still closed, refusing " << ch << std::endl;
+		return false;
+	}
+	return true;
+}
+
+
+///---------------------------------------------------------
+/// Switch a relay the same way the WebSocket set command does
+///---------------------------------------------------------
+bool SweepEngine::SetRelay(unsigned short int ch, bool on)
+{
+	if ( on ? !MayClose(ch) : !InBank(ch) ) return false;
+
+	std::unique_lock<std::mutex> lk(relayMutex);
+	if ( gSerial -> SetPinStat(ch, on) )
+	{
+		gGrid -> Set(ch, on);
+		lk . unlock();
+		closedRelay = on ? ch : -1;
+		if ( gServer ) gServer -> BroadcastState();
+		return true;
+	}
+	lk . unlock();
+
+	std::cerr << "[kulgadd::SweepEngine::SetRelay] Fail to set pin " << ch << " to " << on << " via serial" << std::endl;
+	return false;
+}
+
+
+///---------------------------------------------------------
+/// Write one channel as CSV
+///---------------------------------------------------------
+bool SweepEngine::WriteChannel(const std::string& dir, const ScanJob& job, unsigned short int ch, const std::vector<IVPoint>& points)
+{
+	if ( points . empty() ) return true;
+
+	std::error_code ec;
+	std::filesystem::create_directories(dir, ec);
+	if ( ec )
+	{
+		std::cerr << "[kulgadd::SweepEngine::WriteChannel] Cannot create " << dir << ": " << ec . message() << std::endl;
+		return false;
+	}
+
+	char name[64];
+	snprintf(name, sizeof(name), "_ch%03u.csv", ch);
+	std::ofstream out(dir + "/" + job . sensorname + name);
+	if ( !out ) return false;
+
+	out << "V,I,t\n";
+	out . precision(15);
+	for ( const auto& p : points ) out << p . V << "," << p . I << "," << p . t << "\n";
+	return out . good();
+}
+
+
+///---------------------------------------------------------
+/// Report to whoever follows the progress
+///---------------------------------------------------------
+void SweepEngine::Emit(ProgressKind kind, unsigned short int ch, double V, double I, bool ok)
+{
+	if ( !listener ) return;
+	double t = std::chrono::duration<double>(std::chrono::system_clock::now() . time_since_epoch()) . count();
+	listener(ProgressEvent{ kind, ch, V, I, t, ok });
+}
+
+
+///---------------------------------------------------------
+/// Same layout as iv_all.py
+///---------------------------------------------------------
+std::string SweepEngine::DefaultBasePath()
+{
+	std::time_t now = std::time(nullptr);
+	std::tm tm = *std::localtime(&now);
+	char day[16], stamp[32];
+	std::strftime(day,   sizeof(day),   "%Y-%m-%d",        &tm);
+	std::strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H%M%S", &tm);
+	return std::string("../../result/") + day + "/" + stamp;
+}
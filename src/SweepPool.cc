@@ -0,0 +1,252 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   SweepPool.cc
+///
+///   The definition of SweepPool class.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include "global.hh"
+#include "SweepPool.hh"
+
+#include <cstdio>
+#include <thread>
+#include <sstream>
+#include <iostream>
+#include <sys/time.h>
+
+
+
+///-----------------------------------------------------------------------------
+/// Constructors and destructors
+///-----------------------------------------------------------------------------
+SweepPool::SweepPool()
+{
+	SetSMU("/dev/ttyUSB0");
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Public methods
+///-----------------------------------------------------------------------------
+///---------------------------------------------------------
+/// Parse "url[@first-last],..." into workers
+///---------------------------------------------------------
+bool SweepPool::SetSMU(const std::string& spec)
+{
+	std::vector<Worker> parsed;
+	std::stringstream ss(spec);
+	std::string item;
+	while ( std::getline(ss, item, ',') )
+	{
+		if ( item . empty() ) continue;
+
+		Worker w;
+		w . firstRow = -1;
+		w . lastRow  = -1;
+
+		size_t at = item . rfind('@');
+		if ( at != std::string::npos )
+		{
+			if ( sscanf(item . c_str() + at + 1, "%d-%d", &w . firstRow, &w . lastRow) != 2 || w . firstRow < 0 || w . lastRow < w . firstRow )
+			{
+				std::cerr << "[kulgadd::SweepPool::SetSMU] Bad bank in \"" << item << "\"" << std::endl;
+				return false;
+			}
+			item . resize(at);
+		}
+		w . url = item;
+		parsed . push_back(std::move(w));
+	}
+
+	if ( parsed . empty() )
+	{
+		std::cerr << "[kulgadd::SweepPool::SetSMU] No SMU in \"" << spec << "\"" << std::endl;
+		return false;
+	}
+
+	//--------------------------------------
+	// Banks are all given or all left out, and never overlap:
+	// two SMUs must not share a row of the matrix
+	//--------------------------------------
+	bool explicitBanks = parsed[0] . firstRow >= 0;
+	for ( size_t i = 0; i < parsed . size(); i++ )
+	{
+		if ( (parsed[i] . firstRow >= 0) != explicitBanks )
+		{
+			std::cerr << "[kulgadd::SweepPool::SetSMU] Give a bank for every SMU or for none" << std::endl;
+			return false;
+		}
+		for ( size_t k = 0; explicitBanks && k < i; k++ )
+		{
+			if ( parsed[i] . firstRow <= parsed[k] . lastRow && parsed[k] . firstRow <= parsed[i] . lastRow )
+			{
+				std::cerr << "[kulgadd::SweepPool::SetSMU] Banks of " << parsed[k] . url << " and " << parsed[i] . url << " overlap" << std::endl;
+				return false;
+			}
+		}
+	}
+
+	for ( auto& w : parsed )
+	{
+		w . engine = std::make_unique<SweepEngine>();
+		w . engine -> SetSMU(w . url);
+		w . engine -> SetListener(listener);
+	}
+	workers = std::move(parsed);
+
+	if ( gVerbose > 1 )
+	{
+		std::cout << "[kulgadd::SweepPool::SetSMU] " << workers . size() << " SMU(s)" << std::endl;
+	}
+	return true;
+}
+
+
+///---------------------------------------------------------
+/// Every worker reports to the same listener
+///---------------------------------------------------------
+void SweepPool::SetListener(std::function<void(const ProgressEvent&)> l)
+{
+	listener = std::move(l);
+	for ( auto& w : workers ) w . engine -> SetListener(listener);
+}
+
+
+///---------------------------------------------------------
+/// Split the job by bank and sweep the banks in parallel
+///---------------------------------------------------------
+bool SweepPool::Run(const ScanJob& job, struct rusage* usage)
+{
+	unsigned short int rows = gGrid ? gGrid -> GetRows() : 16;
+	unsigned short int cols = gGrid ? gGrid -> GetCols() : 16;
+	if ( !AssignBanks(rows) ) return false;
+
+	std::vector<unsigned short int> channels = job . channels;
+	if ( channels . empty() )
+	{
+		for ( unsigned short int ch = 0; ch < rows * cols; ch++ ) channels . push_back(ch);
+	}
+
+	//--------------------------------------
+	// Every channel goes to the one SMU whose bank holds its row
+	//--------------------------------------
+	std::vector<ScanJob> parts(workers . size(), job);
+	for ( auto& part : parts ) part . channels . clear();
+	for ( unsigned short int ch : channels )
+	{
+		size_t i = 0;
+		while ( i < workers . size() && !workers[i] . engine -> InBank(ch) ) i++;
+		if ( i == workers . size() )
+		{
+			std::cerr << "[kulgadd::SweepPool::Run] No SMU reaches channel " << ch << std::endl;
+			return false;
+		}
+		parts[i] . channels . push_back(ch);
+	}
+
+	//--------------------------------------
+	// Run. A failing SMU does not stop the others; their data is still good.
+	//--------------------------------------
+	std::vector<std::thread> threads;
+	std::vector<char> ok(workers . size(), 1);
+	std::vector<struct rusage> used(workers . size());
+	for ( size_t i = 0; i < workers . size(); i++ )
+	{
+		if ( parts[i] . channels . empty() ) continue;
+
+		if ( gVerbose > 0 )
+		{
+			std::cout << "[kulgadd::SweepPool::Run] " << workers[i] . url << ": " << parts[i] . channels . size() << " channels" << std::endl;
+		}
+
+		threads . emplace_back([this, i, &parts, &ok, &used]
+		{
+			ok[i] = workers[i] . engine -> Run(parts[i]);
+			getrusage(RUSAGE_THREAD, &used[i]);
+		});
+	}
+	for ( auto& t : threads ) t . join();
+
+	if ( usage )
+	{
+		*usage = {};
+		for ( size_t i = 0; i < workers . size(); i++ )
+		{
+			if ( parts[i] . channels . empty() ) continue;
+			timeradd(&usage -> ru_utime, &used[i] . ru_utime, &usage -> ru_utime);
+			timeradd(&usage -> ru_stime, &used[i] . ru_stime, &usage -> ru_stime);
+		}
+		struct rusage self;
+		getrusage(RUSAGE_SELF, &self);
+		usage -> ru_maxrss = self . ru_maxrss;
+	}
+
+	for ( char o : ok )
+	{
+		if ( !o ) return false;
+	}
+	return true;
+}
+
+
+///---------------------------------------------------------
+/// Abort every worker
+///---------------------------------------------------------
+void SweepPool::Abort()
+{
+	for ( auto& w : workers ) w . engine -> Abort();
+}
+
+
+///---------------------------------------------------------
+/// Forget an old abort, before a new job
+///---------------------------------------------------------
+void SweepPool::ClearAbort()
+{
+	for ( auto& w : workers ) w . engine -> ClearAbort();
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Private methods
+///-----------------------------------------------------------------------------
+///---------------------------------------------------------
+/// Give every worker its rows
+///---------------------------------------------------------
+bool SweepPool::AssignBanks(unsigned short int rows)
+{
+	size_t n = workers . size();
+	for ( size_t i = 0; i < n; i++ )
+	{
+		Worker& w = workers[i];
+		if ( w . firstRow < 0 )
+		{
+			// Even split, the first banks take the remainder
+			int base = rows / n, extra = rows % n;
+			int first = i * base + std::min<int>(i, extra);
+			w . engine -> SetBank(first, first + base + (static_cast<int>(i) < extra ? 1 : 0) - 1);
+		}
+		else if ( w . lastRow >= rows )
+		{
+			std::cerr << "[kulgadd::SweepPool::AssignBanks] Bank of " << w . url << " is beyond row " << rows - 1 << std::endl;
+			return false;
+		}
+		else
+		{
+			w . engine -> SetBank(w . firstRow, w . lastRow);
+		}
+	}
+	return true;
+}
@@ -0,0 +1,113 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   ThreadPool.cc
+///
+///   The definition of ThreadPool class.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include "ThreadPool.hh"
+
+#include <iostream>
+#include <algorithm>
+
+
+
+///-----------------------------------------------------------------------------
+/// Constructors and destructors
+///-----------------------------------------------------------------------------
+ThreadPool::~ThreadPool()
+{
+	Stop();
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Public methods
+///-----------------------------------------------------------------------------
+///-----------------------------------------------
+/// Start the threads
+///-----------------------------------------------
+void ThreadPool::Start(unsigned int n)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = false;
+	}
+	for ( unsigned int i = 0; i < std::max(1u, n); ++i ) threads . emplace_back(&ThreadPool::Run, this);
+}
+
+
+///-----------------------------------------------
+/// Let running tasks finish and join
+///-----------------------------------------------
+void ThreadPool::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		tasks . clear();
+	}
+	cv . notify_all();
+
+	for ( auto& t : threads ) if ( t . joinable() ) t . join();
+	threads . clear();
+}
+
+
+///-----------------------------------------------
+/// Queue a task
+///-----------------------------------------------
+void ThreadPool::Post(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if ( stopping ) return;
+		tasks . push_back(std::move(task));
+	}
+	cv . notify_one();
+}
+
+
+
+
+///-----------------------------------------------------------------------------
+/// Private methods
+///-----------------------------------------------------------------------------
+///-----------------------------------------------
+/// Thread body
+///-----------------------------------------------
+void ThreadPool::Run()
+{
+	while ( true )
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cv . wait(lock, [this] { return stopping || !tasks . empty(); });
+			if ( stopping ) return;
+			task = std::move(tasks . front());
+			tasks . pop_front();
+		}
+
+		// A task that throws must not take the thread down
+		try
+		{
+			task();
+		}
+		catch ( std::exception& e )
+		{
+			std::cerr << "[kulgadd::ThreadPool::Run] Task failed: " << e . what() << std::endl;
+		}
+	}
+}
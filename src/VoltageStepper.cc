@@ -0,0 +1,133 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///   VoltageStepper.cc
+///
+///   The definition of VoltageStepper class.
+///
+///   Authors: Hoyong Jeong (hoyong5419@korea.ac.kr)
+///            Kyungmin Lee (  railroad@korea.ac.kr)
+///            Changi Jeong (  jchg3876@korea.ac.kr)
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+///-----------------------------------------------------------------------------
+/// Headers
+///-----------------------------------------------------------------------------
+#include <cmath>
+#include <algorithm>
+
+#include "VoltageStepper.hh"
+
+
+
+///-----------------------------------------------------------------------------
+/// Anonymous namespace
+///-----------------------------------------------------------------------------
+namespace
+{
+	// Aim of one step, in decades of current
+	constexpr double kDecadesPerStep = 0.1;
+
+	// Step change allowed per point
+	constexpr double kShrink = 0.25;
+	constexpr double kGrow   = 2;
+
+	// Below the SMU's noise; keeps log|I| finite at 0 A
+	constexpr double kCurrentFloor = 1e-12;
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Constructors and destructors
+///-----------------------------------------------------------------------------
+VoltageStepper::VoltageStepper(const ScanJob& job)
+	: adaptive(job . stepping == Stepping::Adaptive), Vstart(job . Vstart), Vend(job . Vend),
+	  dir(job . Vend >= job . Vstart ? 1 : -1), VstepMin(job . VstepMin), VstepMax(job . VstepMax),
+	  limit(0), count(0), fed(0), last(false), setV(job . Vstart), step(job . Vstep),
+	  havePrev(false), prevV(0), prevL(0), haveSlope(false), prevSlope(0)
+{
+	if ( adaptive )
+	{
+		limit = job . maxPoints;
+	}
+	else
+	{
+		fixed = job . Voltages();
+		limit = fixed . size();
+	}
+}
+
+
+
+///-----------------------------------------------------------------------------
+/// Methods
+///-----------------------------------------------------------------------------
+///-----------------------------------------------
+/// Next set point
+///-----------------------------------------------
+std::optional<double> VoltageStepper::Next()
+{
+	if ( last || count >= limit ) return std::nullopt;
+
+	double v;
+	if ( !adaptive )
+	{
+		v = fixed[count];
+		last = (count + 1 == fixed . size());
+	}
+	else
+	{
+		if ( count == 0 )
+		{
+			v = Vstart;
+		}
+		else
+		{
+			// Never fall so far behind that Vend is out of the point budget,
+			// but never step wider than VstepMax to catch up either. ScanJob
+			// makes sure the budget covers the range at VstepMax.
+			double left = std::abs(Vend - setV);
+			double s = std::min(VstepMax, std::max(step, left / (limit - count)));
+			v = (s >= left - 1e-9) ? Vend : setV + dir * s;
+		}
+		last = (std::abs(v - Vend) < 1e-9);
+	}
+
+	setV = v;
+	count++;
+	return v;
+}
+
+
+///-----------------------------------------------
+/// Rescale the step from the point just measured
+///-----------------------------------------------
+void VoltageStepper::Feed(double V, double I)
+{
+	fed++;
+	if ( !adaptive ) return;
+
+	double L = std::log10(std::abs(I) + kCurrentFloor);
+	if ( havePrev && V != prevV )
+	{
+		// How far the last step moved the curve: its own rise and
+		// the bend against the step before
+		double slope = (L - prevL) / std::abs(V - prevV);
+		double change = std::abs(L - prevL);
+		if ( haveSlope ) change = std::max(change, std::abs(slope - prevSlope) * step);
+
+		double factor = change > 0 ? kDecadesPerStep / change : kGrow;
+		factor = std::clamp(factor, kShrink, kGrow);
+		step = std::clamp(step * factor, VstepMin, VstepMax);
+
+		prevSlope = slope;
+		haveSlope = true;
+	}
+
+	havePrev = true;
+	prevV = V;
+	prevL = L;
+}
@@ -17,11 +17,16 @@
 ///-----------------------------------------------------------------------------
 #include "global.hh"
 #include "WebSocketServer.hh"
+#include "SweepEngine.hh"
 
 #include <iostream>
+#include <algorithm>
 #include <cstring>
+#include <cctype>
 #include <chrono>
 #include <thread>
+#include <unordered_map>
+#include <limits>
 #include <nlohmann/json.hpp>
 #include <libwebsockets.h>
 #include <arpa/inet.h>
@@ -68,12 +73,18 @@ namespace
 				g_instance -> OnClientDisconnected(wsi);
 				break;
 
-			// A client has sent any message?
+			// A client has sent any message? It may come in fragments.
 			case LWS_CALLBACK_RECEIVE:
-				g_instance -> OnClientMessage(wsi, std::string((const char*)in, len));
+				g_instance -> OnClientReceive(wsi, (const char*)in, len, lws_is_final_fragment(wsi) && !lws_remaining_packet_payload(wsi), lws_frame_is_binary(wsi));
 				break;
 
+			// Room on the socket: write the next queued message
 			case LWS_CALLBACK_SERVER_WRITEABLE:
+				return g_instance -> OnClientWritable(wsi);
+
+			// Another thread queued messages
+			case LWS_CALLBACK_EVENT_WAIT_CANCELLED:
+				if ( g_instance ) g_instance -> OnWake();
 				break;
 
 			default:
@@ -83,20 +94,98 @@ namespace
 		return 0;
 	}
 
+	// A client this far behind for this long is dropped
+	constexpr std::chrono::seconds kSlowTimeout(10);
+
+	// Queued messages beyond which live curves are thinned out,
+	// and the coarsest decimation a live client gets or asks for
+	constexpr size_t kLiveBacklog = 16;
+	constexpr unsigned int kMaxStride = 64;
+
+	// Longest pin state interval a client may ask for
+	constexpr long long kMaxStateInterval = 60000;
+
+	// Largest client message, and largest receive buffer kept for reuse
+	constexpr size_t kMaxMessage = 1 << 20;
+	constexpr size_t kMaxPooled  = 64 << 10;
+
+	// Commands a client may have waiting for their turn
+	constexpr size_t kMaxCommands = 256;
+
+	// Job ids, and the priorities the scan schema accepts
+	constexpr long long kMaxJob = std::numeric_limits<unsigned int>::max();
+	constexpr long long kMinPriority = -1000;
+	constexpr long long kMaxPriority = 1000;
+
+	// The subprotocol a client asks for picks its encoding; id is the
+	// WebSocketServer::Encoding
 	static struct lws_protocols protocols[] =
 	{
 		{
 			"ws",                // Protocol name. Must be same as frontend's code
 			websocket_callback,  // Callback function pointer
 			0,
-			4096
+			4096,
+			0                    // JSON text frames
 		},
+		{ "ws.cbor",    websocket_callback, 0, 4096, 1 },  // CBOR binary frames
+		{ "ws.msgpack", websocket_callback, 0, 4096, 2 },  // MessagePack binary frames
 		{ nullptr, nullptr, 0, 0 }  // Protocol list ends with null.
 	};
+
+	// Subscription names, by Topic
+	static const char* const topicNames[] =
+	{
+		"state",
+		"state-delta",
+		"serial-raw",
+		"scan-log",
+		"scan-progress",
+		"metrics"
+	};
+	static_assert(sizeof(topicNames) / sizeof(topicNames[0]) == static_cast<size_t>(Topic::Count));
+
+	// Compression, if the client offers it
+	static const struct lws_extension extensions[] =
+	{
+		{
+			"permessage-deflate",
+			lws_extension_callback_pm_deflate,
+			"permessage-deflate; client_max_window_bits"
+		},
+		{ nullptr, nullptr, nullptr }
+	};
+
+	// Numbers from clients are read wide and signed, so -1 or 65539 cannot
+	// wrap onto a real channel or job. -1 unless an integer in 0..max.
+	static long long Index(const json& v, long long max)
+	{
+		long long n = v . is_number_integer() ? v . get<long long>() : -1;
+		return ( n >= 0 && n <= max ) ? n : -1;
+	}
 } 
 
 
 
+///-----------------------------------------------------------------------------
+/// One client command on its way through its handler
+///-----------------------------------------------------------------------------
+struct WebSocketServer::Command
+{
+	lws* wsi = nullptr;
+	std::uint64_t serial = 0;                                // Connection it came from
+	Encoding encoding = Encoding::Json;                      // Of the text
+	std::chrono::steady_clock::time_point received;
+	std::string text;                                        // As received; the buffer is reused
+	json request;
+	json result;                                             // Goes back in the ack
+	std::string error;                                       // Goes back in the error
+	bool ok = false;
+	bool (WebSocketServer::*local)(Command&) = nullptr;      // Left for the service thread
+};
+
+
+
 ///-----------------------------------------------------------------------------
 /// Constructors and destructor
 ///-----------------------------------------------------------------------------
@@ -153,6 +242,7 @@ bool WebSocketServer::Start(int port)
 	isRunning = true;
 	g_instance = this;
 
+	workers . Start(commandThreads);
 	serverThread = std::thread(&WebSocketServer::ServerLoop, this);
 	return true;
 }
@@ -168,6 +258,7 @@ void WebSocketServer::Stop()
 
 	if ( context                          ) lws_cancel_service(context);
 	if ( serverThread . joinable()        ) serverThread . join();
+	workers . Stop();
 
 	//--------------------------------------
 	// Debugging message
@@ -179,6 +270,16 @@ void WebSocketServer::Stop()
 }
 
 
+///---------------------------------------------------------
+/// Compression of outgoing messages
+///---------------------------------------------------------
+void WebSocketServer::SetCompression(int level, int windowBits)
+{
+	deflateLevel  = std::clamp(level, 0, 9);
+	deflateWindow = std::clamp(windowBits, 9, 15);
+}
+
+
 
 ///-----------------------------------------------------------------------------
 /// Private methods
@@ -205,6 +306,7 @@ void WebSocketServer::ServerLoop()
 	info . protocols = protocols;
 	info . gid = -1;
 	info . uid = -1;
+	if ( deflateLevel > 0 ) info . extensions = extensions;
 
 	context = lws_create_context(&info);
 
@@ -223,6 +325,7 @@ void WebSocketServer::ServerLoop()
 	while ( isRunning )
 	{
 		lws_service(context, 50);
+		OnTick();
 	}
 
 	//--------------------------------------
@@ -246,9 +349,29 @@ void WebSocketServer::OnClientConnected(lws* wsi)
 		std::cout << "[kulgadd::WebSocketServer::OnClientConnected] Greetings to the new client and send the current stat" << std::endl;
 	}
 
-	std::lock_guard<std::mutex> lock(clientMutex);
-	clients . insert(wsi);
-	SendToClient(wsi, pinGrid -> ToJSONString());
+	Client& c = clients[wsi];
+	c . serial = nextSerial++;
+	if ( !rxPool . empty() )
+	{
+		c . rx = std::move(rxPool . back());
+		rxPool . pop_back();
+	}
+	const lws_protocols* protocol = lws_get_protocol(wsi);
+	if ( protocol ) c . encoding = static_cast<Encoding>(protocol -> id);
+
+	// Takes effect before the first compressed frame; a smaller window
+	// than negotiated is always fine for the client
+	if ( deflateLevel > 0 )
+	{
+		lws_set_extension_option(wsi, "permessage-deflate", "compression_level", std::to_string(deflateLevel) . c_str());
+		lws_set_extension_option(wsi, "permessage-deflate", "server_max_window_bits", std::to_string(deflateWindow) . c_str());
+	}
+
+	std::map<Encoding, OutboundMessage> encoded;
+	Enqueue(c, Encode(OutboundMessage{ std::make_shared<Payload>(pinGrid -> ToJSONString(), LWS_PRE), false, Backlog::Replace, "state" }, c . encoding, encoded));
+	c . lastState = std::chrono::steady_clock::now();
+	lws_callback_on_writable(wsi);
+	UpdateWanted();
 }
 
 
@@ -265,71 +388,188 @@ void WebSocketServer::OnClientDisconnected(lws* wsi)
 		std::cout << "[kulgadd::WebSocketServer::OnClientConnected] Goodbye my client" << std::endl;
 	}
 
-	std::lock_guard<std::mutex> lock(clientMutex);
-	clients . erase(wsi);
+	// Its receive buffer goes back to the pool, unless grown too big
+	auto it = clients . find(wsi);
+	if ( it == clients . end() ) return;
+	if ( it -> second . rx . capacity() <= kMaxPooled )
+	{
+		it -> second . rx . clear();
+		rxPool . push_back(std::move(it -> second . rx));
+	}
+
+	clients . erase(it);
+	UpdateWanted();
 }
 
 
 ///---------------------------------------------------------
-/// On client message
+/// On client data: put fragments together in the client's
+/// buffer and queue the message once complete
 ///---------------------------------------------------------
-void WebSocketServer::OnClientMessage(lws* wsi, const std::string& msg)
+void WebSocketServer::OnClientReceive(lws* wsi, const char* data, size_t len, bool final, bool binary)
 {
+	auto it = clients . find(wsi);
+	if ( it == clients . end() ) return;
+	Client& c = it -> second;
+
+	if ( !c . rxOverflow )
+	{
+		if ( c . rx . size() + len > kMaxMessage )
+		{
+			c . rxOverflow = true;
+			c . rx . clear();
+		}
+		else
+		{
+			c . rx . append(data, len);
+		}
+	}
+	if ( !final ) return;
+
+	if ( c . rxOverflow )
+	{
+		std::cerr << "[kulgadd::WebSocketServer::OnClientReceive] Message over " << kMaxMessage << " bytes dropped" << std::endl;
+		c . rxOverflow = false;
+		SendToClient(wsi, "{\"error\":{\"message\":\"message too large\"}}");
+		return;
+	}
+
+	if ( c . commands . size() >= kMaxCommands )
+	{
+		std::cerr << "[kulgadd::WebSocketServer::OnClientReceive] Too many commands waiting, one dropped" << std::endl;
+		c . rx . clear();
+		SendToClient(wsi, "{\"error\":{\"message\":\"too many commands\"}}");
+		return;
+	}
+
 	//--------------------------------------
-	// Debugging message
+	// The message goes to the command workers in a pooled command;
+	// the client receives on into the buffer that command had
 	//--------------------------------------
-	if ( gVerbose > 1 )
+	std::shared_ptr<Command> cmd;
+	if ( !commandPool . empty() )
 	{
-		std::cout << "[kulgadd::WebSocketServer::OnClientMessage] A message received from a client: " << msg << std::endl;
+		cmd = std::move(commandPool . back());
+		commandPool . pop_back();
 	}
+	else
+	{
+		cmd = std::make_shared<Command>();
+	}
+	cmd -> wsi      = wsi;
+	cmd -> serial   = c . serial;
+	cmd -> encoding = binary ? c . encoding : Encoding::Json;
+	cmd -> received = std::chrono::steady_clock::now();
+	std::swap(cmd -> text, c . rx);
 
-	try
+	c . commands . push_back(std::move(cmd));
+	RunNext(c);
+}
+
+
+///---------------------------------------------------------
+/// Write the next queued message
+///---------------------------------------------------------
+int WebSocketServer::OnClientWritable(lws* wsi)
+{
+	auto it = clients . find(wsi);
+	if ( it == clients . end() ) return 0;
+	Client& c = it -> second;
+
+	if ( c . kick )
 	{
-		auto j = json::parse(msg);
-		if ( j . contains("cmd") && j["cmd"] . is_string() && j["cmd"] == "set" )
+		std::cerr << "[kulgadd::WebSocketServer::OnClientWritable] Closing a client that cannot keep up" << std::endl;
+		const char reason[] = "too slow";
+		lws_close_reason(wsi, LWS_CLOSE_STATUS_POLICY_VIOLATION, (unsigned char*)reason, sizeof(reason) - 1);
+		return -1;
+	}
+
+	auto m = c . queue . Pop();
+	if ( !m ) return 0;
+
+	// Written in place: the payload has LWS_PRE of headroom
+	size_t len = m -> payload -> Size();
+	if ( lws_write(wsi, m -> payload -> Data(), len, m -> binary ? LWS_WRITE_BINARY : LWS_WRITE_TEXT) < (int)len ) return -1;
+
+	if ( !c . queue . Empty() ) lws_callback_on_writable(wsi);
+	return 0;
+}
+
+
+///---------------------------------------------------------
+/// Woken up by a publisher: fan the outbox out to the clients
+/// and ask for room where messages wait
+///---------------------------------------------------------
+void WebSocketServer::OnWake()
+{
+	while ( auto p = outbox . Pop() )
+	{
+		if ( p -> done )
+		{
+			Finish(std::move(p -> done));
+		}
+		else if ( p -> wsi )
 		{
-			int ch = j["ch"];
-			bool val = j["val"];
-			if ( ch >= 0 && ch < 256 )
+			// Not for a newer connection on the same wsi
+			auto it = clients . find(p -> wsi);
+			std::map<Encoding, OutboundMessage> encoded;
+			if ( it != clients . end() && ( !p -> serial || p -> serial == it -> second . serial ) )
 			{
-				if ( serial -> SetPinStat(ch, val) )
-				{
-					pinGrid -> Set(ch, val);
-					BroadcastState();
-				}
-				else
-				{
-					std::cerr << "[kulgadd::WebSocketServer::OnClientMessage] Fail to set pin stat via serial" << std::endl;
-				}
+				Enqueue(it -> second, Encode(p -> message, it -> second . encoding, encoded));
 			}
 		}
-		else if ( j . contains("cmd") && j["cmd"] . is_string() && j["cmd"] == "get" )
+		else if ( p -> curve )
 		{
-			serial -> WriteLine("PINSTAT all");
+			// One encoding per decimation stride in use
+			std::map<unsigned int, std::shared_ptr<Payload>> encoded;
+			for ( auto& [wsi, c] : clients ) EnqueueCurve(c, *p -> curve, encoded);
 		}
-		else if ( j . contains("cmd") && j["cmd"] . is_string() && j["cmd"] == "scan" )
+		else if ( p -> topic == Topic::State )
 		{
-			// Dryrun
-			if ( j . contains("mode") && j["mode"] . is_string() )
+			// Clients within their interval get the newest state later, from OnTick
+			latestState = p -> message;
+			auto now = std::chrono::steady_clock::now();
+			std::map<Encoding, OutboundMessage> encoded;
+			for ( auto& [wsi, c] : clients )
 			{
-				if      ( j["mode"] == "dryrun" )
-				{
-					if ( gVerbose > 1 ) std::cout << "[kulgadd::SerialManager::Monitor] Scan started with dryrun option" << std::endl;
-					gScan -> Start(1);
-					gScan -> Wait();
-				}
-				else if ( j["mode"] == "normal" )
-				{
-					if ( gVerbose > 1 ) std::cout << "[kulgadd::SerialManager::Monitor] Scan started with normal option" << std::endl;
-					gScan -> Start(0);
-					gScan -> Wait();
-				}
+				if ( !(c . topics & Bit(Topic::State)) ) continue;
+				if ( now - c . lastState >= c . stateInterval . value_or(stateInterval) ) EnqueueState(c, encoded);
+				else c . stateDue = true;
 			}
 		}
+		else
+		{
+			// Transcoded once per encoding in use, for subscribers only
+			std::map<Encoding, OutboundMessage> encoded;
+			for ( auto& [wsi, c] : clients )
+			{
+				if ( c . topics & Bit(p -> topic) ) Enqueue(c, Encode(p -> message, c . encoding, encoded));
+			}
+		}
+	}
+
+	for ( auto& [wsi, c] : clients )
+	{
+		if ( !c . queue . Empty() || c . kick ) lws_callback_on_writable(wsi);
 	}
-	catch (std::exception& e)
+}
+
+
+///---------------------------------------------------------
+/// Every turn of the service loop: states whose interval is over
+///---------------------------------------------------------
+void WebSocketServer::OnTick()
+{
+	if ( !latestState ) return;
+
+	auto now = std::chrono::steady_clock::now();
+	std::map<Encoding, OutboundMessage> encoded;
+	for ( auto& [wsi, c] : clients )
 	{
-		std::cerr << "JSON parse error: " << e . what() << std::endl;
+		if ( !(c . topics & Bit(Topic::State)) ) continue;
+		if ( !c . stateDue || now - c . lastState < c . stateInterval . value_or(stateInterval) ) continue;
+		EnqueueState(c, encoded);
+		lws_callback_on_writable(wsi);
 	}
 }
 
@@ -347,21 +587,35 @@ void WebSocketServer::BroadcastState()
 		std::cout << "[kulgadd::WebSocketServer::BroadcastState] Broadcasting" << std::endl;
 	}
 
-	std::lock_guard<std::mutex> lock(clientMutex);
-	std::string state = pinGrid -> ToJSONString();
-	for ( lws* wsi : clients )
+	//--------------------------------------
+	// Pins changed since the last broadcast. Kept up to date even
+	// without subscribers, so a new one starts from the right place.
+	//--------------------------------------
+	json delta;
+	delta["delta"]["pins"] = json::array();
 	{
-		SendToClient(wsi, state);
+		std::lock_guard<std::mutex> lock(deltaMutex);
+		unsigned short int total = pinGrid -> GetTotal();
+		lastPins . resize(total, false);
+		for ( unsigned short int ch = 0; ch < total; ++ch )
+		{
+			bool val = pinGrid -> Get(ch);
+			if ( val == lastPins[ch] ) continue;
+			lastPins[ch] = val;
+			delta["delta"]["pins"] . push_back({ ch, val ? 1 : 0 });
+		}
 	}
+	if ( Wants(Topic::StateDelta) && !delta["delta"]["pins"] . empty() ) Deliver(Topic::StateDelta, delta . dump());
 
-	return;
+	// Only the newest state matters to a client that lags behind
+	if ( Wants(Topic::State) ) Deliver(Topic::State, pinGrid -> ToJSONString(), Backlog::Replace, "state");
 }
 
 
 ///---------------------------------------------------------
 /// Send to client
 ///---------------------------------------------------------
-void WebSocketServer::SendToClient(lws* wsi, const std::string& msg)
+void WebSocketServer::SendToClient(lws* wsi, const std::string& msg, bool binary)
 {
 	//--------------------------------------
 	// Debugging message
@@ -371,27 +625,31 @@ void WebSocketServer::SendToClient(lws* wsi, const std::string& msg)
 		std::cout << "[kulgadd::WebSocketServer::SendToClient] Sending message" << std::endl;
 	}
 
-	size_t len = msg . size();
-	std::vector<unsigned char> buf(LWS_PRE + len);
-	std::memcpy(&buf[LWS_PRE], msg . data(), len);
-	lws_write(wsi, &buf[LWS_PRE], len, LWS_WRITE_TEXT);
+	Publish({ wsi, Topic::Count, OutboundMessage{ std::make_shared<Payload>(msg, LWS_PRE), binary, Backlog::Keep, "" }, std::nullopt, 0, nullptr });
 }
 
 
 ///---------------------------------------------------------
 /// Deliver
 ///---------------------------------------------------------
-void WebSocketServer::Deliver(const std::string& msg)
+void WebSocketServer::Deliver(Topic topic, const std::string& msg, Backlog backlog, const std::string& key)
 {
-	for ( lws* wsi : clients )
-	{
-		SendToClient(wsi, msg);
-	}
+	// Serialized once; every subscriber's queue shares the payload
+	Publish({ nullptr, topic, OutboundMessage{ std::make_shared<Payload>(msg, LWS_PRE), false, backlog, key }, std::nullopt, 0, nullptr });
 
 	return;
 }
 
 
+///---------------------------------------------------------
+/// Deliver live curve points to the clients watching the channel
+///---------------------------------------------------------
+void WebSocketServer::DeliverCurve(const CurveFrame& frame)
+{
+	Publish({ nullptr, Topic::Count, OutboundMessage(), frame, 0, nullptr });
+}
+
+
 ///---------------------------------------------------------
 /// Allowed IPs
 ///---------------------------------------------------------
@@ -408,3 +666,690 @@ bool WebSocketServer::IsIPAllowed(const char* ipStr)
 	//--------------------------------------
 	return (addr . s_addr & mask . s_addr) == (net . s_addr & mask . s_addr);
 }
+
+
+///---------------------------------------------------------
+/// set: pins as one switching transaction, in one of
+///   ch/val:        one pin
+///   pins:          [[ch,val],...]
+///   mask:          hex string, the last digit holds channels 0-3; every channel
+///   exclusive: ch  that channel on, every other one off
+/// Whole-grid forms switch only the pins that change.
+///---------------------------------------------------------
+bool WebSocketServer::CmdSet(Command& c)
+{
+	const json& r = c . request;
+	unsigned short int total = pinGrid -> GetTotal();
+	auto value = [](const json& v) { return v . is_boolean() ? v . get<bool>() : v . get<int>() != 0; };
+
+	auto channel = [total](const json& v) { return static_cast<int>(Index(v, total - 1)); };
+	auto outOfRange = [&c]()
+	{
+		c . error = "channel out of range";
+		return false;
+	};
+
+	// Diff, switch and grid update as one, whichever worker runs it. The
+	// sweep engines switch under the same lock, so a sweep that has
+	// started is seen below before it can close a relay.
+	std::lock_guard<std::mutex> lock(SweepEngine::RelayMutex());
+
+	//--------------------------------------
+	// What to switch
+	//--------------------------------------
+	std::vector<std::pair<unsigned short int, bool>> pins;
+	std::vector<bool> target;  // Whole-grid forms
+	if ( r . contains("pins") )
+	{
+		// Switched OFFs first, so a channel listed twice would end up other than the grid says
+		std::vector<bool> seen(total, false);
+		for ( const auto& p : r["pins"] )
+		{
+			int ch = channel(p . at(0));
+			if ( ch < 0 ) return outOfRange();
+			if ( seen[ch] )
+			{
+				c . error = "channel " + std::to_string(ch) + " listed twice";
+				return false;
+			}
+			seen[ch] = true;
+			pins . push_back({ ch, value(p . at(1)) });
+		}
+	}
+	else if ( (r . contains("mask") || r . contains("exclusive")) && gScan -> IsSweeping() )
+	{
+		// Would open the relay a sweep is biasing
+		c . error = "a sweep is switching the matrix";
+		return false;
+	}
+	else if ( r . contains("mask") )
+	{
+		std::string hex = r["mask"];
+		if ( hex . rfind("0x", 0) == 0 || hex . rfind("0X", 0) == 0 ) hex . erase(0, 2);
+		if ( hex . empty() || hex . size() * 4 > total + 3u || hex . find_first_not_of("0123456789abcdefABCDEF") != std::string::npos )
+		{
+			c . error = "bad mask";
+			return false;
+		}
+		target . assign(total, false);
+		for ( size_t i = 0; i < hex . size(); ++i )
+		{
+			char h = std::tolower(hex[hex . size() - 1 - i]);
+			int digit = std::isdigit(h) ? h - '0' : h - 'a' + 10;
+			for ( int b = 0; b < 4 && i * 4 + b < total; ++b ) target[i * 4 + b] = digit >> b & 1;
+		}
+	}
+	else if ( r . contains("exclusive") )
+	{
+		int ch = channel(r["exclusive"]);
+		if ( ch < 0 ) return outOfRange();
+		target . assign(total, false);
+		target[ch] = true;
+	}
+	else
+	{
+		// at: a missing key throws, and Execute replies with the error
+		int ch = channel(r . at("ch"));
+		if ( ch < 0 ) return outOfRange();
+		pins . push_back({ ch, value(r . at("val")) });
+	}
+
+	for ( unsigned short int ch = 0; ch < target . size(); ++ch )
+	{
+		if ( target[ch] != pinGrid -> Get(ch) ) pins . push_back({ ch, target[ch] });
+	}
+
+	//--------------------------------------
+	// Switch, then tell everyone once
+	//--------------------------------------
+	if ( !pins . empty() && !serial -> SetPinStats(pins) )
+	{
+		// Undone, unless the undo failed too: ask the firmware to be sure
+		serial -> WriteLine("PINSTAT all");
+		c . error = "fail to set pin stat via serial";
+		return false;
+	}
+
+	for ( const auto& p : pins ) pinGrid -> Set(p . first, p . second);
+	BroadcastState();
+	c . result["switched"] = pins . size();
+	return true;
+}
+
+
+///---------------------------------------------------------
+/// get: ask the firmware; the state follows as a broadcast
+///---------------------------------------------------------
+bool WebSocketServer::CmdGet(Command& c)
+{
+	if ( !serial -> WriteLine("PINSTAT all") )
+	{
+		c . error = "fail to write to serial";
+		return false;
+	}
+	return true;
+}
+
+
+///---------------------------------------------------------
+/// scan: queue a parameterized scan. Absent parameters take the defaults.
+///---------------------------------------------------------
+bool WebSocketServer::CmdScan(Command& c)
+{
+	ScanJob job;
+	if ( !job . FromJSONString(c . text, &c . error) )
+	{
+		c . error = "invalid scan parameters: " + c . error;
+		return false;
+	}
+
+	unsigned int id = gScan -> Enqueue(job);
+	if ( gVerbose > 1 ) std::cout << "[kulgadd::WebSocketServer::CmdScan] Scan job " << id << " queued" << std::endl;
+	c . result["job"] = id;
+	return true;
+}
+
+
+///---------------------------------------------------------
+/// Queries. The answer goes out ahead of the ack.
+///---------------------------------------------------------
+bool WebSocketServer::CmdSchema(Command& c)
+{
+	Send(c, ScanJob::SchemaToJSONString());
+	return true;
+}
+
+bool WebSocketServer::CmdJobs(Command& c)
+{
+	Send(c, gScan -> JobsToJSONString());
+	return true;
+}
+
+bool WebSocketServer::CmdProgress(Command& c)
+{
+	Send(c, gScan -> ProgressToJSONString());
+	return true;
+}
+
+bool WebSocketServer::CmdWorker(Command& c)
+{
+	Send(c, gScan -> WorkerToJSONString());
+	return true;
+}
+
+bool WebSocketServer::CmdHistory(Command& c)
+{
+	std::optional<unsigned int> job;
+	if ( c . request . contains("job") )
+	{
+		long long id = Index(c . request["job"], kMaxJob);
+		if ( id < 0 )
+		{
+			c . error = "bad job id";
+			return false;
+		}
+		job = id;
+	}
+	Send(c, gScan -> HistoryToJSONString(job));
+	return true;
+}
+
+bool WebSocketServer::CmdHeatmap(Command& c)
+{
+	Send(c, gScan -> HeatmapToJSONString());
+	return true;
+}
+
+bool WebSocketServer::CmdCurve(Command& c)
+{
+	long long job = Index(c . request["job"], kMaxJob);
+	if ( job < 0 )
+	{
+		c . error = "bad job id";
+		return false;
+	}
+	std::optional<unsigned short int> ch;
+	if ( c . request . contains("ch") )
+	{
+		long long n = Index(c . request["ch"], pinGrid -> GetTotal() - 1);
+		if ( n < 0 )
+		{
+			c . error = "channel out of range";
+			return false;
+		}
+		ch = n;
+	}
+	Send(c, gScan -> CurveToJSONString(job, ch));
+	return true;
+}
+
+bool WebSocketServer::CmdCheckpoints(Command& c)
+{
+	Send(c, gScan -> CheckpointsToJSONString());
+	return true;
+}
+
+
+///---------------------------------------------------------
+/// rate: own pin state interval in ms; 0 for every change, as the scan script wants
+///---------------------------------------------------------
+bool WebSocketServer::CmdRate(Command& c)
+{
+	auto it = clients . find(c . wsi);
+	if ( it == clients . end() )
+	{
+		c . error = "unknown client";
+		return false;
+	}
+	if ( c . request . contains("state") )
+	{
+		const json& v = c . request["state"];
+		if ( !v . is_number_integer() || v . get<long long>() < 0 )
+		{
+			c . error = "state must be a non-negative interval in ms";
+			return false;
+		}
+		it -> second . stateInterval = std::chrono::milliseconds(std::min(kMaxStateInterval, v . get<long long>()));
+	}
+
+	json r;
+	r["rate"]["state"] = it -> second . stateInterval . value_or(stateInterval) . count();
+	Send(c, r . dump());
+	c . result = r["rate"];
+	return true;
+}
+
+
+///---------------------------------------------------------
+/// live: curve frames. No channels key means all channels, an empty list unsubscribes.
+///---------------------------------------------------------
+bool WebSocketServer::CmdLive(Command& c)
+{
+	LiveSubscription sub;
+	if ( c . request . contains("channels") )
+	{
+		sub . all = false;
+		for ( const auto& v : c . request["channels"] )
+		{
+			long long ch = Index(v, pinGrid -> GetTotal() - 1);
+			if ( ch < 0 )
+			{
+				c . error = "channel out of range";
+				return false;
+			}
+			sub . channels . insert(ch);
+		}
+	}
+	if ( c . request . contains("every") )
+	{
+		const json& v = c . request["every"];
+		if ( !v . is_number_integer() || v . get<long long>() < 1 )
+		{
+			c . error = "every must be a positive integer";
+			return false;
+		}
+		sub . every = static_cast<unsigned int>(std::min<long long>(kMaxStride, v . get<long long>()));
+	}
+	sub . stride = sub . every;
+
+	json r;
+	r["live"]["channels"] = sub . all ? json("all") : json(sub . channels);
+	r["live"]["every"]    = sub . every;
+
+	auto it = clients . find(c . wsi);
+	if ( it == clients . end() )
+	{
+		c . error = "unknown client";
+		return false;
+	}
+	if ( sub . all || !sub . channels . empty() ) it -> second . live = sub;
+	else it -> second . live . reset();
+	Send(c, r . dump());
+	c . result = r["live"];
+	return true;
+}
+
+
+///---------------------------------------------------------
+/// subscribe/unsubscribe: topics by name; unknown names are ignored
+///---------------------------------------------------------
+bool WebSocketServer::CmdSubscribe(Command& c)
+{
+	auto it = clients . find(c . wsi);
+	if ( it == clients . end() )
+	{
+		c . error = "unknown client";
+		return false;
+	}
+
+	std::uint32_t mask = 0;
+	for ( const auto& name : c . request . value("topics", json::array()) )
+	{
+		for ( std::uint32_t t = 0; t < static_cast<std::uint32_t>(Topic::Count); ++t )
+		{
+			if ( name . is_string() && name == topicNames[t] ) mask |= Bit(static_cast<Topic>(t));
+		}
+	}
+	if ( c . request["cmd"] == "subscribe" ) it -> second . topics |=  mask;
+	else                                     it -> second . topics &= ~mask;
+	UpdateWanted();
+
+	json r;
+	r["topics"] = json::array();
+	for ( std::uint32_t t = 0; t < static_cast<std::uint32_t>(Topic::Count); ++t )
+	{
+		if ( it -> second . topics & Bit(static_cast<Topic>(t)) ) r["topics"] . push_back(topicNames[t]);
+	}
+	Send(c, r . dump());
+	c . result = r["topics"];
+	return true;
+}
+
+
+///---------------------------------------------------------
+/// Job control
+///---------------------------------------------------------
+bool WebSocketServer::CmdCancel(Command& c)
+{
+	long long job = Index(c . request["job"], kMaxJob);
+	if ( job < 0 )
+	{
+		c . error = "bad job id";
+		return false;
+	}
+	if ( !gScan -> Cancel(job) )
+	{
+		c . error = "no such job to cancel";
+		return false;
+	}
+	c . result["job"] = job;
+	return true;
+}
+
+bool WebSocketServer::CmdResume(Command& c)
+{
+	long long id = Index(c . request["job"], kMaxJob);
+	if ( id < 0 )
+	{
+		c . error = "bad job id";
+		return false;
+	}
+	unsigned int job = gScan -> Resume(id, &c . error);
+	if ( !job )
+	{
+		c . error = "cannot resume: " + c . error;
+		return false;
+	}
+	c . result["job"] = job;
+	return true;
+}
+
+bool WebSocketServer::CmdReorder(Command& c)
+{
+	long long job = Index(c . request["job"], kMaxJob);
+	if ( job < 0 )
+	{
+		c . error = "bad job id";
+		return false;
+	}
+	const json& p = c . request["priority"];
+	if ( !p . is_number_integer() || p . get<long long>() < kMinPriority || p . get<long long>() > kMaxPriority )
+	{
+		c . error = "priority must be an integer in " + std::to_string(kMinPriority) + ".." + std::to_string(kMaxPriority);
+		return false;
+	}
+	if ( !gScan -> Reorder(job, p . get<int>()) )
+	{
+		c . error = "no such queued job to reorder";
+		return false;
+	}
+	c . result["job"] = job;
+	return true;
+}
+
+
+///---------------------------------------------------------
+/// Hand the client's next command to a worker, unless one is
+/// still running: a client's commands run one at a time, in order
+///---------------------------------------------------------
+void WebSocketServer::RunNext(Client& c)
+{
+	if ( c . busy || c . commands . empty() ) return;
+	c . busy = true;
+
+	std::shared_ptr<Command> cmd = std::move(c . commands . front());
+	c . commands . pop_front();
+	workers . Post([this, cmd]
+	{
+		Execute(*cmd);
+		Publish({ cmd -> wsi, Topic::Count, OutboundMessage(), std::nullopt, cmd -> serial, cmd });
+	});
+}
+
+
+///---------------------------------------------------------
+/// Run a command, on a worker. With an id, the client gets an
+/// ack carrying the result; failures always come back as errors.
+///---------------------------------------------------------
+void WebSocketServer::Execute(Command& c)
+{
+	// local: touches the client's own settings, left for the service thread
+	struct Handler
+	{
+		bool (WebSocketServer::*run)(Command&);
+		bool local;
+	};
+	static const std::unordered_map<std::string, Handler> handlers =
+	{
+		{ "set",         { &WebSocketServer::CmdSet,         false } },
+		{ "get",         { &WebSocketServer::CmdGet,         false } },
+		{ "scan",        { &WebSocketServer::CmdScan,        false } },
+		{ "schema",      { &WebSocketServer::CmdSchema,      false } },
+		{ "jobs",        { &WebSocketServer::CmdJobs,        false } },
+		{ "progress",    { &WebSocketServer::CmdProgress,    false } },
+		{ "worker",      { &WebSocketServer::CmdWorker,      false } },
+		{ "history",     { &WebSocketServer::CmdHistory,     false } },
+		{ "rate",        { &WebSocketServer::CmdRate,        true  } },
+		{ "heatmap",     { &WebSocketServer::CmdHeatmap,     false } },
+		{ "curve",       { &WebSocketServer::CmdCurve,       false } },
+		{ "live",        { &WebSocketServer::CmdLive,        true  } },
+		{ "subscribe",   { &WebSocketServer::CmdSubscribe,   true  } },
+		{ "unsubscribe", { &WebSocketServer::CmdSubscribe,   true  } },
+		{ "cancel",      { &WebSocketServer::CmdCancel,      false } },
+		{ "checkpoints", { &WebSocketServer::CmdCheckpoints, false } },
+		{ "resume",      { &WebSocketServer::CmdResume,      false } },
+		{ "reorder",     { &WebSocketServer::CmdReorder,     false } }
+	};
+
+	//--------------------------------------
+	// Debugging message
+	//--------------------------------------
+	if ( gVerbose > 1 && c . encoding == Encoding::Json )
+	{
+		std::cout << "[kulgadd::WebSocketServer::Execute] A message received from a client: " << c . text << std::endl;
+	}
+
+	try
+	{
+		// Binary clients talk in their own encoding; the text is kept as JSON
+		if      ( c . encoding == Encoding::Cbor    ) c . request = json::from_cbor(c . text);
+		else if ( c . encoding == Encoding::MsgPack ) c . request = json::from_msgpack(c . text);
+		else                                          c . request = json::parse(c . text);
+		if ( c . encoding != Encoding::Json ) c . text = c . request . dump();
+
+		if ( !c . request . is_object() || !c . request . contains("cmd") || !c . request["cmd"] . is_string() )
+		{
+			c . error = "no command";
+		}
+		else
+		{
+			auto it = handlers . find(c . request["cmd"] . get<std::string>());
+			if ( it == handlers . end() )
+			{
+				c . error = "unknown command";
+			}
+			else if ( it -> second . local )
+			{
+				c . local = it -> second . run;
+				return;
+			}
+			else
+			{
+				c . ok = (this ->* it -> second . run)(c);
+			}
+		}
+	}
+	catch ( std::exception& e )
+	{
+		// Malformed JSON or a parameter of the wrong type
+		c . error = e . what();
+		c . ok = false;
+	}
+
+	Reply(c);
+}
+
+
+///---------------------------------------------------------
+/// Back on the service thread: run what was left for it, then
+/// the client's next command
+///---------------------------------------------------------
+void WebSocketServer::Finish(std::shared_ptr<Command> cmd)
+{
+	// A connection closed meanwhile may have left its wsi to a new one
+	auto it = clients . find(cmd -> wsi);
+	Client* c = ( it != clients . end() && it -> second . serial == cmd -> serial ) ? &it -> second : nullptr;
+
+	if ( c && cmd -> local )
+	{
+		try
+		{
+			cmd -> ok = (this ->* cmd -> local)(*cmd);
+		}
+		catch ( std::exception& e )
+		{
+			cmd -> error = e . what();
+			cmd -> ok = false;
+		}
+		Reply(*cmd);
+	}
+
+	//--------------------------------------
+	// Back to the pool, buffer capacity and all
+	//--------------------------------------
+	if ( cmd -> text . capacity() <= kMaxPooled )
+	{
+		cmd -> text . clear();
+		cmd -> request = nullptr;
+		cmd -> result  = nullptr;
+		cmd -> error . clear();
+		cmd -> ok      = false;
+		cmd -> local   = nullptr;
+		commandPool . push_back(std::move(cmd));
+	}
+
+	if ( c )
+	{
+		c -> busy = false;
+		RunNext(*c);
+	}
+}
+
+
+///---------------------------------------------------------
+/// Ack or error for a command
+///---------------------------------------------------------
+void WebSocketServer::Reply(Command& c)
+{
+	if ( !c . ok )
+	{
+		std::cerr << "[kulgadd::WebSocketServer::Reply] " << c . error << std::endl;
+	}
+	if ( c . ok && !c . request . contains("id") ) return;
+
+	json r;
+	const char* kind = c . ok ? "ack" : "error";
+	if ( c . request . is_object() && c . request . contains("id") ) r[kind]["id"] = c . request["id"];
+	if ( c . request . is_object() && c . request . contains("cmd") ) r[kind]["cmd"] = c . request["cmd"];
+	if ( c . ok ) r[kind]["result"]  = c . result;
+	else          r[kind]["message"] = c . error;
+	r[kind]["latency"] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - c . received) . count();
+	Send(c, r . dump());
+}
+
+
+///---------------------------------------------------------
+/// Send to the connection a command came from
+///---------------------------------------------------------
+void WebSocketServer::Send(const Command& c, const std::string& msg)
+{
+	Publish({ c . wsi, Topic::Count, OutboundMessage{ std::make_shared<Payload>(msg, LWS_PRE), false, Backlog::Keep, "" }, std::nullopt, c . serial, nullptr });
+}
+
+
+///---------------------------------------------------------
+/// Hand a message to the service thread and wake it up
+///---------------------------------------------------------
+void WebSocketServer::Publish(Publication p)
+{
+	outbox . Push(std::move(p));
+	if ( context ) lws_cancel_service(context);
+}
+
+
+///---------------------------------------------------------
+/// Topics some client takes, for publishers to check
+///---------------------------------------------------------
+void WebSocketServer::UpdateWanted()
+{
+	std::uint32_t mask = 0;
+	for ( const auto& [wsi, c] : clients ) mask |= c . topics;
+	wanted . store(mask, std::memory_order_relaxed);
+}
+
+
+///---------------------------------------------------------
+/// Queue a message for one client
+///---------------------------------------------------------
+void WebSocketServer::Enqueue(Client& c, OutboundMessage m)
+{
+	if ( c . kick ) return;
+
+	// Full of messages it must get, or lagging for too long: let it go
+	auto now = std::chrono::steady_clock::now();
+	if ( !c . queue . Push(std::move(m)) )
+	{
+		c . kick = true;
+	}
+	else if ( c . queue . Backlogged() )
+	{
+		if ( !c . slow ) c . slowSince = now;
+		c . slow = true;
+		if ( now - c . slowSince > kSlowTimeout ) c . kick = true;
+	}
+	else
+	{
+		c . slow = false;
+	}
+}
+
+
+///---------------------------------------------------------
+/// Queue the newest pin state for a client
+///---------------------------------------------------------
+void WebSocketServer::EnqueueState(Client& c, std::map<Encoding, OutboundMessage>& encoded)
+{
+	Enqueue(c, Encode(*latestState, c . encoding, encoded));
+	c . lastState = std::chrono::steady_clock::now();
+	c . stateDue = false;
+}
+
+
+///---------------------------------------------------------
+/// Queue live curve points for a client watching the channel
+///---------------------------------------------------------
+void WebSocketServer::EnqueueCurve(Client& c, const CurveFrame& frame, std::map<unsigned int, std::shared_ptr<Payload>>& encoded)
+{
+	if ( !c . live ) return;
+	LiveSubscription& sub = *c . live;
+	if ( !sub . all && !sub . channels . count(frame . ch) ) return;
+
+	// Lagging client: drop this frame and thin out the next ones.
+	// Channel ends always go out, so the client can close the curve.
+	if ( c . queue . Size() > kLiveBacklog )
+	{
+		sub . stride = std::min(kMaxStride, sub . stride * 2);
+		if ( !frame . last ) return;
+	}
+	else if ( sub . stride > sub . every )
+	{
+		sub . stride = std::max(sub . every, sub . stride / 2);
+	}
+
+	auto& payload = encoded[sub . stride];
+	if ( !payload ) payload = std::make_shared<Payload>(LiveCurve::Encode(frame, sub . stride), LWS_PRE);
+	Enqueue(c, OutboundMessage{ payload, true, Backlog::Drop, "" });
+}
+
+
+///---------------------------------------------------------
+/// A message in the client's encoding. JSON text goes to CBOR or
+/// MessagePack binary frames; anything else passes unchanged.
+///---------------------------------------------------------
+OutboundMessage WebSocketServer::Encode(const OutboundMessage& m, Encoding e, std::map<Encoding, OutboundMessage>& encoded)
+{
+	if ( e == Encoding::Json || m . binary ) return m;
+
+	auto it = encoded . find(e);
+	if ( it != encoded . end() ) return it -> second;
+
+	json j = json::parse(m . payload -> Data(), m . payload -> Data() + m . payload -> Size(), nullptr, false);
+	if ( j . is_discarded() ) return m;  // Not JSON, e.g. a raw firmware line
+
+	std::vector<std::uint8_t> bytes = (e == Encoding::Cbor) ? json::to_cbor(j) : json::to_msgpack(j);
+	OutboundMessage out = m;
+	out . payload = std::make_shared<Payload>(bytes . data(), bytes . size(), LWS_PRE);
+	out . binary  = true;
+	encoded[e] = out;
+	return out;
+}
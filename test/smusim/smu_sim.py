@@ -0,0 +1,75 @@
+#-------------------------------------------------------------------------------
+# smu_sim.py
+#
+# Minimal SCPI source-meter simulator for native sweeps.
+# Run it and start kulgadd with --smu tcp://localhost:5025
+#-------------------------------------------------------------------------------
+
+
+import argparse
+import math
+import socketserver
+
+
+class SMU:
+	def __init__(self, vbd, leak):
+		self.vbd = vbd
+		self.leak = leak
+		self.v = 0.0
+		self.icomp = 1e-5
+		self.output = False
+
+	def current(self):
+		if not self.output:
+			return 0.0
+		# Leakage plus an exponential breakdown beyond |Vbd|
+		i = self.leak * self.v
+		if abs(self.v) > abs(self.vbd):
+			i += math.copysign(1e-9 * math.exp(abs(self.v) - abs(self.vbd)), self.v)
+		return max(-self.icomp, min(self.icomp, i))
+
+	def handle(self, line):
+		cmd = line.strip()
+		up = cmd.upper()
+		if up.startswith(":SOUR:VOLT ") and not up.startswith(":SOUR:VOLT:"):
+			self.v = float(cmd.split()[1])
+		elif up.startswith(":SENS:CURR:PROT "):
+			self.icomp = float(cmd.split()[1])
+		elif up == ":OUTP ON":
+			self.output = True
+		elif up == ":OUTP OFF":
+			self.output = False
+		elif up == "*RST":
+			self.__init__(self.vbd, self.leak)
+		elif up == ":READ?":
+			return f"{self.v:e},{self.current():e}"
+		elif up == "*OPC?":
+			return "1"
+		elif up == "*IDN?":
+			return "KULGADD,SMU simulator,0,0"
+		return None
+
+
+def main():
+	parser = argparse.ArgumentParser(description="SCPI SMU simulator")
+	parser.add_argument('--port', type=int,   default=5025,  help="TCP port")
+	parser.add_argument('--Vbd',  type=float, default=-200,  help="Breakdown voltage")
+	parser.add_argument('--leak', type=float, default=1e-10, help="Leakage conductance [A/V]")
+	args = parser.parse_args()
+
+	class Handler(socketserver.StreamRequestHandler):
+		def handle(self):
+			smu = SMU(args.Vbd, args.leak)
+			for raw in self.rfile:
+				reply = smu.handle(raw.decode())
+				if reply is not None:
+					self.wfile.write((reply + "\n").encode())
+
+	socketserver.TCPServer.allow_reuse_address = True
+	with socketserver.ThreadingTCPServer(("localhost", args.port), Handler) as server:
+		print(f"SMU simulator on port {args.port}")
+		server.serve_forever()
+
+
+if __name__ == "__main__":
+	main()